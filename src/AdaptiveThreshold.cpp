@@ -0,0 +1,112 @@
+#include "AdaptiveThreshold.h"
+
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "Utils.h"
+
+using namespace std;
+using namespace cv;
+
+// Rows per parallel_for_ stripe. Tracker regions are usually a single stripe and stay on the calling thread.
+static const int rowsPerStripe = 64;
+
+AdaptiveThreshold::AdaptiveThreshold(vector<int> windowSizes, double constant) {
+    // The same adjustments adaptiveThreshold and ArucoDetector make: odd windows of at least 3, and the floor of the
+    // constant for THRESH_BINARY_INV.
+    int maxWindow = 3;
+    for (int& window : windowSizes) {
+        window = max(3, window | 1);
+        maxWindow = max(maxWindow, window);
+    }
+
+    this->windowSizes = windowSizes;
+    this->constant = cvFloor(constant);
+    this->radius = maxWindow / 2;
+
+    binaryBuffers.resize(windowSizes.size());
+}
+
+const vector<int>& AdaptiveThreshold::getWindowSizes() const {
+    return windowSizes;
+}
+
+void AdaptiveThreshold::apply(const Mat& image, vector<Mat>& binaries) {
+    prepare(image, binaries);
+
+    parallel_for_(Range(0, image.rows), [this, &image, &binaries](const Range& rows) {
+        applyRows(image, binaries, rows.start, rows.end);
+    }, max(1, image.rows / rowsPerStripe));
+}
+
+void AdaptiveThreshold::prepare(const Mat& image, vector<Mat>& binaries) {
+    CV_Assert(image.type() == CV_8UC1);
+
+    // Already the right size, so copyMakeBorder and integral write into the reused buffers rather than allocating.
+    Size paddedSize(image.cols + 2 * radius, image.rows + 2 * radius);
+    padded = fitBuffer(paddedBuffer, paddedSize, CV_8UC1);
+    sums = fitBuffer(sumsBuffer, Size(paddedSize.width + 1, paddedSize.height + 1), CV_32SC1);
+
+    // Isolated, so a region of a larger frame replicates its own edge, as adaptiveThreshold does, instead of reading
+    // the pixels around it.
+    copyMakeBorder(image, padded, radius, radius, radius, radius, BORDER_REPLICATE | BORDER_ISOLATED);
+    cv::integral(padded, sums, CV_32S);
+
+    binaries.resize(windowSizes.size());
+    for (int w = 0; w < binaries.size(); w++) {
+        binaries[w] = fitBuffer(binaryBuffers[w], image.size(), CV_8UC1);
+    }
+}
+
+void AdaptiveThreshold::applyRows(const Mat& image, vector<Mat>& binaries, int begin, int end) const {
+    for (int w = 0; w < windowSizes.size(); w++) {
+        int half = windowSizes[w] / 2;
+        // The window sum over its area is never exactly halfway between two integers, as the area is odd, so rounding
+        // in float lands on the same mean boxFilter computes.
+        float scale = 1.f / static_cast<float>(windowSizes[w] * windowSizes[w]);
+
+        int left = radius - half;
+        int right = radius + half + 1;
+
+        for (int y = begin; y < end; y++) {
+            const int* top = sums.ptr<int>(y + radius - half);
+            const int* bottom = sums.ptr<int>(y + radius + half + 1);
+            const uchar* source = image.ptr<uchar>(y);
+            uchar* target = binaries[w].ptr<uchar>(y);
+
+            int x = 0;
+#if CV_SIMD
+            v_float32 vscale = vx_setall_f32(scale);
+            v_int32 vconstant = vx_setall_s32(constant);
+
+            for (; x <= image.cols - v_uint8::nlanes; x += v_uint8::nlanes) {
+                v_int32 masks[4];
+                for (int g = 0; g < 4; g++) {
+                    int o = x + g * v_int32::nlanes;
+
+                    v_int32 sum = vx_load(bottom + right + o) - vx_load(bottom + left + o) - vx_load(top + right + o) +
+                        vx_load(top + left + o);
+                    v_int32 mean = v_round(v_cvt_f32(sum) * vscale);
+                    v_int32 pixel = v_reinterpret_as_s32(vx_load_expand_q(source + o));
+
+                    masks[g] = pixel + vconstant <= mean;
+                }
+
+                // Masks are 0 or -1, which saturate through both packs to 0 or 255.
+                v_int8 mask = v_pack(v_pack(masks[0], masks[1]), v_pack(masks[2], masks[3]));
+                v_store(target + x, v_reinterpret_as_u8(mask));
+            }
+#endif
+
+            for (; x < image.cols; x++) {
+                int sum = bottom[right + x] - bottom[left + x] - top[right + x] + top[left + x];
+                int mean = cvRound(static_cast<float>(sum) * scale);
+
+                target[x] = source[x] + constant <= mean ? 255 : 0;
+            }
+        }
+    }
+}
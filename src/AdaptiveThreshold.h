@@ -0,0 +1,41 @@
+#ifndef ADAPTIVETHRESHOLD_H
+#define ADAPTIVETHRESHOLD_H
+
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+
+// Binarizes an 8-bit image at several window sizes, producing for each exactly what
+// cv::adaptiveThreshold(image, binary, 255, ADAPTIVE_THRESH_MEAN_C, THRESH_BINARY_INV, window, constant) does: a pixel
+// is set when it's at least constant below the mean of the window around it, with the image edge replicated.
+//
+// Every window is read from one integral image rather than a box filter per window. The per-pixel loop uses OpenCV's
+// universal intrinsics, so it's SSE/AVX2 on x86 and NEON on ARM, and rows are split across parallel_for_ stripes.
+class AdaptiveThreshold {
+    public:
+        AdaptiveThreshold(std::vector<int> windowSizes, double constant);
+
+        // Fills binaries with one image per window size, in order. They're views of buffers reused between calls, only
+        // valid until the next call, so a stream of differently sized images stops allocating after the largest.
+        void apply(const cv::Mat& image, std::vector<cv::Mat>& binaries);
+
+        // apply in two steps, for callers that spread rows over their own threads: prepare once, then applyRows over
+        // rows [begin, end) until every row is covered.
+        void prepare(const cv::Mat& image, std::vector<cv::Mat>& binaries);
+        void applyRows(const cv::Mat& image, std::vector<cv::Mat>& binaries, int begin, int end) const;
+
+        const std::vector<int>& getWindowSizes() const;
+    private:
+        std::vector<int> windowSizes;
+        int constant;
+        int radius;
+
+        cv::Mat padded;
+        cv::Mat sums;
+
+        cv::Mat paddedBuffer;
+        cv::Mat sumsBuffer;
+        std::vector<cv::Mat> binaryBuffers;
+};
+
+#endif //ADAPTIVETHRESHOLD_H
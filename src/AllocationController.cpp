@@ -0,0 +1,133 @@
+#include "AllocationController.h"
+
+#include <algorithm>
+#include <string>
+
+#include "Log.h"
+
+using namespace std;
+
+AllocationParameters::AllocationParameters() {
+    this->totalThreads = 1;
+    this->minThreadsPerCamera = 1;
+    this->intervalMicros = 500000;
+    this->smoothing = 0.3;
+    this->explorationWeight = 0.1;
+    this->frameRateHeadroom = 1.2;
+}
+
+AllocationController::AllocationController(AllocationParameters params, int cameraCount) {
+    this->params = params;
+
+    estimates = vector<CameraEstimate>(cameraCount, CameraEstimate());
+    allocation = vector<int>(cameraCount, 0);
+
+    lastUpdate = 0;
+}
+
+double AllocationController::usefulRate(const CameraEstimate& estimate, int threads) const {
+    double framesPerSecond = min(estimate.framesPerSecond * params.frameRateHeadroom,
+        threads * 1e6 / estimate.costMicros);
+
+    return (estimate.usefulRatio + params.explorationWeight) * framesPerSecond;
+}
+
+int64_t AllocationController::update(vector<Camera>& cameras, int64_t now) {
+    if (lastUpdate == 0) {
+        lastUpdate = now;
+        for (int a = 0; a < cameras.size(); a++) {
+            estimates[a].captured = cameras[a].frameCounts().captured;
+        }
+    }
+
+    int64_t elapsed = now - lastUpdate;
+    if (elapsed < params.intervalMicros) {
+        return params.intervalMicros - elapsed;
+    }
+    lastUpdate = now;
+
+    for (int a = 0; a < cameras.size(); a++) {
+        CameraEstimate& estimate = estimates[a];
+
+        // The totals are read one at a time, so an iteration finishing in between is split across two intervals.
+        const CameraThreadset& threadset = *cameras[a].threadset;
+        uint64_t totalIterations = threadset.iterations.load(memory_order_relaxed);
+        uint64_t totalUseful = threadset.usefulIterations.load(memory_order_relaxed);
+        int64_t totalBusyMicros = threadset.busyMicros.load(memory_order_relaxed);
+
+        uint64_t iterations = totalIterations - estimate.iterations;
+        uint64_t usefulIterations = totalUseful - estimate.usefulIterations;
+        int64_t busyMicros = totalBusyMicros - estimate.busyMicros;
+        estimate.iterations = totalIterations;
+        estimate.usefulIterations = totalUseful;
+        estimate.busyMicros = totalBusyMicros;
+
+        uint64_t captured = cameras[a].frameCounts().captured;
+        double framesPerSecond = (captured - estimate.captured) * 1e6 / elapsed;
+        estimate.captured = captured;
+
+        // Cost and usefulness can only be measured from finished frames; without any the last estimates stand.
+        if (iterations == 0) {
+            estimate.framesPerSecond += params.smoothing * (framesPerSecond - estimate.framesPerSecond);
+            continue;
+        }
+
+        double costMicros = static_cast<double>(busyMicros) / iterations;
+        double usefulRatio = static_cast<double>(usefulIterations) / iterations;
+
+        if (!estimate.measured) {
+            estimate.measured = true;
+            estimate.costMicros = costMicros;
+            estimate.framesPerSecond = framesPerSecond;
+            estimate.usefulRatio = usefulRatio;
+        } else {
+            estimate.costMicros += params.smoothing * (costMicros - estimate.costMicros);
+            estimate.framesPerSecond += params.smoothing * (framesPerSecond - estimate.framesPerSecond);
+            estimate.usefulRatio += params.smoothing * (usefulRatio - estimate.usefulRatio);
+        }
+    }
+
+    vector<int> threads(cameras.size(), params.minThreadsPerCamera);
+    int spare = params.totalThreads - params.minThreadsPerCamera * static_cast<int>(cameras.size());
+
+    for (; spare > 0; spare--) {
+        int best = -1;
+        double bestGain = 0;
+
+        for (int a = 0; a < cameras.size(); a++) {
+            // A camera that hasn't finished a frame yet keeps its minimum until it has a cost.
+            if (!estimates[a].measured || estimates[a].costMicros <= 0) {
+                continue;
+            }
+
+            double gain = usefulRate(estimates[a], threads[a] + 1) - usefulRate(estimates[a], threads[a]);
+            if (gain > bestGain) {
+                best = a;
+                bestGain = gain;
+            }
+        }
+
+        if (best < 0) {
+            break;
+        }
+        threads[best] += 1;
+    }
+
+    if (threads != allocation) {
+        allocation = threads;
+
+        string report;
+        for (int a = 0; a < cameras.size(); a++) {
+            cameras[a].threadset->totalThreads.store(threads[a], memory_order_relaxed);
+
+            report += (a == 0 ? "" : ", ") + to_string(a) + ": " + to_string(threads[a]) + " (" +
+                to_string(static_cast<int>(estimates[a].costMicros / 1000)) + " ms, " +
+                to_string(static_cast<int>(estimates[a].framesPerSecond)) + " fps, " +
+                to_string(static_cast<int>(estimates[a].usefulRatio * 100)) + "% with tags)";
+        }
+
+        LOG_INFO("Workers per camera: %s", report.c_str());
+    }
+
+    return params.intervalMicros;
+}
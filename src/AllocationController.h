@@ -0,0 +1,62 @@
+#ifndef ALLOCATIONCONTROLLER_H
+#define ALLOCATIONCONTROLLER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "Camera.h"
+
+struct AllocationParameters {
+    // Workers shared by every camera, the pool's size.
+    int totalThreads;
+    int minThreadsPerCamera;
+    int64_t intervalMicros;
+
+    // Weight of the newest interval in each camera's running estimates.
+    double smoothing;
+    // Added to every camera's useful frame ratio, so cameras that see no tags still get enough workers to notice when
+    // one comes into view, and frames are split by throughput when no camera sees any.
+    double explorationWeight;
+    // Workers are given to keep up with this multiple of a camera's frame rate, so a frame rarely waits for one.
+    double frameRateHeadroom;
+
+    AllocationParameters();
+};
+
+// Hands out the pool's workers between cameras by what each one returns: a camera's worker limit is raised while
+// another worker means more frames with tags detected per second, across all cameras, than it would anywhere else.
+//
+// Each interval every camera's detection cost per frame, frame rate and share of frames with tags are measured and
+// smoothed. A camera with n workers detects min(frameRate, n / cost) frames a second, so each extra worker is worth
+// less than the last, and handing workers out one at a time to the highest bidder is optimal. Workers no camera can use
+// are left idle.
+class AllocationController {
+    public:
+        AllocationController(AllocationParameters params, int cameraCount);
+
+        // Reallocates when an interval has passed. Returns how long until it next needs to run.
+        int64_t update(std::vector<Camera>& cameras, int64_t now);
+    private:
+        struct CameraEstimate {
+            uint64_t iterations;
+            uint64_t usefulIterations;
+            int64_t busyMicros;
+            uint64_t captured;
+
+            bool measured;
+            double costMicros;
+            double framesPerSecond;
+            double usefulRatio;
+        };
+
+        AllocationParameters params;
+        std::vector<CameraEstimate> estimates;
+        std::vector<int> allocation;
+
+        int64_t lastUpdate;
+
+        // Frames with tags a camera detects per second with this many workers.
+        double usefulRate(const CameraEstimate& estimate, int threads) const;
+};
+
+#endif //ALLOCATIONCONTROLLER_H
@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/objdetect/aruco_detector.hpp>
+#include <opencv2/objdetect/aruco_dictionary.hpp>
+
+#include <ntcore/networktables/RawTopic.h>
+
+#include "Camera.h"
+#include "FrameSource.h"
+#include "SceneGenerator.h"
+#include "TagTracker.h"
+#include "ThresholdDetector.h"
+
+using namespace cv;
+using namespace std;
+
+// Checks that once warmed up, Camera::runIteration makes no heap allocations on the thread running it. Frames are
+// synthetic scenes replayed from memory, detected with ThresholdDetector on a single tile at decimation 2, so
+// decimation, thresholding, quad search, decoding, corner refinement, tracking, pose solving and the frame record are
+// all covered.
+//
+// Left out, as they still allocate: ArucoDetector, tiles spread over a pool, the field solve (solvePnP) and publishing
+// to a live NetworkTables instance, which copies the record. The publisher here is unbound, so Set does nothing.
+//
+// usage: fisheye_allocation_test
+
+// Only this thread's allocations are counted; the capture thread renders and copies frames in the meantime. cv::Mat
+// data comes from fastMalloc rather than new, but every buffer is tracked by a UMatData the allocator news, so those
+// are counted too.
+static thread_local uint64_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations += 1;
+
+    void* memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr) {
+        throw bad_alloc();
+    }
+
+    return memory;
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+    allocations += 1;
+
+    size_t bytes = static_cast<size_t>(alignment);
+    void* memory = aligned_alloc(bytes, (max<size_t>(size, 1) + bytes - 1) / bytes * bytes);
+    if (memory == nullptr) {
+        throw bad_alloc();
+    }
+
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, align_val_t) noexcept {
+    free(memory);
+}
+
+static const int preloadedFrames = 20;
+// Passes over the preloaded frames before counting starts, so every buffer has grown to the largest frame and region
+// it will see.
+static const int warmupPasses = 3;
+static const int measuredPasses = 2;
+static const int maxTagsPerFrame = 16;
+
+int main() {
+    SourceConfig sourceConfig;
+    sourceConfig.type = "synthetic";
+    sourceConfig.realtime = false;
+
+    const SceneConfig& scene = sourceConfig.scene;
+    vector<Mat> images = preloadFrames(sourceConfig, preloadedFrames);
+
+    vector<vector<double>> matrix(3, vector<double>(3));
+    for (int a = 0; a < 3; a++) {
+        for (int b = 0; b < 3; b++) {
+            matrix[a][b] = scene.cameraMatrix(a, b);
+        }
+    }
+
+    vector<double> distortion(5);
+    for (int a = 0; a < 5; a++) {
+        distortion[a] = scene.distortionCoefficients(a);
+    }
+
+    ThresholdParameters thresholdParams;
+    thresholdParams.simd = true;
+    thresholdParams.tiles = 1;
+
+    int warmupFrames = warmupPasses * preloadedFrames;
+    int measuredFrames = measuredPasses * preloadedFrames;
+
+    Camera camera(0, make_unique<MemorySource>(&images, warmupFrames + measuredFrames), matrix, distortion,
+        nt::RawPublisher(), nullptr, scene.tagSizeMeters, aruco::DetectorParameters(),
+        aruco::getPredefinedDictionary(aruco::DICT_APRILTAG_36h11), 1, 1, maxTagsPerFrame, TrackingParameters(), 2,
+        thresholdParams);
+
+    camera.startCapture();
+
+    for (int i = 0; i < warmupFrames; i++) {
+        camera.runIteration();
+    }
+
+    uint64_t usefulBefore = camera.threadset->usefulIterations.load();
+    uint64_t allocationsBefore = allocations;
+
+    for (int i = 0; i < measuredFrames; i++) {
+        camera.runIteration();
+    }
+
+    uint64_t counted = allocations - allocationsBefore;
+    uint64_t useful = camera.threadset->usefulIterations.load() - usefulBefore;
+
+    camera.joinCapture();
+
+    cout << measuredFrames << " frames, " << useful << " with tags, " << counted << " allocations" << endl;
+
+    // A run that found nothing never reached decoding, refinement or pose solving.
+    if (useful == 0) {
+        cout << "FAILED: no tags found" << endl;
+        return 1;
+    }
+
+    if (counted != 0) {
+        cout << "FAILED: steady-state iterations allocated" << endl;
+        return 1;
+    }
+
+    return 0;
+}
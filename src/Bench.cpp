@@ -0,0 +1,319 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+
+#include <sys/resource.h>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/objdetect/aruco_detector.hpp>
+#include <opencv2/objdetect/aruco_dictionary.hpp>
+
+#include "../include/json.hpp"
+
+#include "../include/BS_thread_pool.hpp"
+
+#include "Camera.h"
+#include "Config.h"
+#include "FieldLayout.h"
+#include "FrameRecord.h"
+#include "Log.h"
+#include "Setup.h"
+#include "StageLog.h"
+#include "Trace.h"
+
+using namespace cv;
+using namespace std;
+using namespace nt;
+
+// Drives a single camera's capture -> findTags -> pose -> publish path over recorded or synthetic frames held in
+// memory, once per resolution and worker count, and reports per-stage latency percentiles, CPU time and throughput
+// as JSON. For synthetic frames, solved tags are matched to the rendered ones by id and corner and pose errors reported
+// alongside.
+//
+// usage: fisheye_bench [bench.json] [results.json]
+//
+// The other config files are read from the directory bench.json is in.
+
+double percentile(vector<double>& values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+
+    sort(values.begin(), values.end());
+    int index = max(0, static_cast<int>(ceil(p / 100.0 * values.size())) - 1);
+
+    return values[index];
+}
+
+nlohmann::json summarizeStage(const StageLog& stageLog, int warmupFrames,
+    function<int64_t(const StageTimings&)> wall, function<int64_t(const StageTimings&)> cpu) {
+    vector<double> latencies;
+    double cpuTotal = 0;
+
+    for (int i = warmupFrames; i < stageLog.size(); i++) {
+        latencies.push_back(wall(stageLog[i]) / 1000.0);
+        cpuTotal += cpu(stageLog[i]) / 1000.0;
+    }
+
+    nlohmann::json stage;
+    stage["p50Ms"] = percentile(latencies, 50);
+    stage["p95Ms"] = percentile(latencies, 95);
+    stage["p99Ms"] = percentile(latencies, 99);
+    stage["cpuMeanMs"] = latencies.empty() ? 0 : cpuTotal / latencies.size();
+
+    return stage;
+}
+
+// Errors of the tags solved after warm-up against the frames' ground truth. A frame's truth is found from its sequence
+// number, since MemorySource replays the preloaded frames in order.
+nlohmann::json summarizeAccuracy(const StageLog& stageLog, int warmupFrames, const vector<vector<SceneTag>>& truths) {
+    int matched = 0;
+    int missed = 0;
+    int falseIds = 0;
+    double squaredCornerError = 0;
+    vector<double> translationErrors;
+    vector<double> rotationErrors;
+
+    for (int i = warmupFrames; i < stageLog.size(); i++) {
+        const StageTimings& timings = stageLog[i];
+        const vector<SceneTag>& truth = truths[(timings.sequence - 1) % truths.size()];
+        const TagObservation* observations = stageLog.observations(i);
+        int frameMatched = 0;
+
+        for (int j = 0; j < timings.observationCount; j++) {
+            const TagObservation& observation = observations[j];
+            auto expected = find_if(truth.begin(), truth.end(), [&observation](const SceneTag& tag) {
+                return tag.id == observation.id;
+            });
+
+            if (expected == truth.end()) {
+                falseIds += 1;
+                continue;
+            }
+
+            frameMatched += 1;
+
+            for (int k = 0; k < 4; k++) {
+                Point2f offset = observation.corners[k] - expected->corners[k];
+                squaredCornerError += offset.dot(offset);
+            }
+
+            translationErrors.push_back(norm(observation.pose.tvec - expected->pose.tvec));
+
+            // Angle of the rotation taking the solved orientation onto the true one.
+            double cosine = (trace(observation.pose.rmat.t() * expected->pose.rmat) - 1) / 2;
+            rotationErrors.push_back(acos(clamp(cosine, -1.0, 1.0)) * 180 / CV_PI);
+        }
+
+        matched += frameMatched;
+        missed += max(0, static_cast<int>(truth.size()) - frameMatched);
+    }
+
+    nlohmann::json accuracy;
+    accuracy["matched"] = matched;
+    accuracy["missed"] = missed;
+    accuracy["falseIds"] = falseIds;
+    accuracy["cornerRmsPx"] = matched > 0 ? sqrt(squaredCornerError / (4 * matched)) : 0.0;
+    accuracy["translationErrorM"]["p50"] = percentile(translationErrors, 50);
+    accuracy["translationErrorM"]["p95"] = percentile(translationErrors, 95);
+    accuracy["translationErrorM"]["p99"] = percentile(translationErrors, 99);
+    accuracy["rotationErrorDeg"]["p50"] = percentile(rotationErrors, 50);
+    accuracy["rotationErrorDeg"]["p95"] = percentile(rotationErrors, 95);
+    accuracy["rotationErrorDeg"]["p99"] = percentile(rotationErrors, 99);
+
+    return accuracy;
+}
+
+int64_t processCpuMicros() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return (static_cast<int64_t>(usage.ru_utime.tv_sec) + usage.ru_stime.tv_sec) * 1000000 +
+        usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+int main(int argc, char** argv) {
+    string benchPath = argc > 1 ? argv[1] : configPath(defaultConfigDir, "bench.json");
+    string configDir = filesystem::path(benchPath).parent_path().string();
+
+    Config config;
+    BenchConfig bench;
+    bool configValid = loadConfig(configDir, config) && loadBenchConfig(benchPath, config, bench);
+
+    bool tracing = setupTrace(config.trace);
+    Log::start();
+
+    if (!configValid) {
+        Log::flush();
+        return 1;
+    }
+
+    const CameraConfig& cameraConfig = config.cameras[bench.camera];
+    const DetectorConfig& detector = config.detector;
+
+    // Runs place capture and worker threads the way the pipeline does, so results match the machine's real layout.
+    const ThreadPlacements& placements = config.threading.placements;
+
+    aruco::Dictionary dict = aruco::getPredefinedDictionary(aruco::DICT_APRILTAG_36h11);
+
+    FieldLayout fieldLayout = setupFieldLayout(detector);
+
+    int frameCount = bench.frames;
+    int warmupFrames = bench.warmupFrames;
+
+    // Held in memory so disk and decoding stay out of the measurements.
+    vector<vector<SceneTag>> truths;
+    vector<Mat> recording = preloadFrames(bench.source, bench.preloadFrames, &truths);
+    if (recording.empty()) {
+        LOG_ERROR("No frames could be read from %s", bench.source.path.c_str());
+        Log::flush();
+        return 1;
+    }
+
+    Size recordedSize = recording[0].size();
+
+    auto ntInst = NetworkTableInstance::Create();
+    auto ntTable = ntInst.GetTable("fisheye_bench");
+
+    nlohmann::json results;
+    results["camera"] = bench.camera;
+    results["recordedFrames"] = recording.size();
+    results["decimation"] = detector.decimation;
+    results["runs"] = nlohmann::json::array();
+
+    for (Size size : bench.resolutions) {
+        vector<Mat> images(recording.size());
+        for (int i = 0; i < recording.size(); i++) {
+            if (size == recordedSize) {
+                images[i] = recording[i];
+            } else {
+                int interpolation = size.area() < recordedSize.area() ? INTER_AREA : INTER_LINEAR;
+                resize(recording[i], images[i], size, 0, 0, interpolation);
+            }
+        }
+
+        // Scale the intrinsics with the image, mapping pixel centers onto pixel centers.
+        double scaleX = static_cast<double>(size.width) / recordedSize.width;
+        double scaleY = static_cast<double>(size.height) / recordedSize.height;
+
+        vector<vector<double>> cameraMatrix = cameraConfig.matrix;
+        cameraMatrix[0][0] *= scaleX;
+        cameraMatrix[0][2] = (cameraMatrix[0][2] + 0.5) * scaleX - 0.5;
+        cameraMatrix[1][1] *= scaleY;
+        cameraMatrix[1][2] = (cameraMatrix[1][2] + 0.5) * scaleY - 0.5;
+
+        // Ground truth corners move with the pixels; poses don't change.
+        vector<vector<SceneTag>> scaledTruths = truths;
+        for (vector<SceneTag>& frameTruth : scaledTruths) {
+            for (SceneTag& tag : frameTruth) {
+                for (Point2f& corner : tag.corners) {
+                    corner.x = (corner.x + 0.5) * scaleX - 0.5;
+                    corner.y = (corner.y + 0.5) * scaleY - 0.5;
+                }
+            }
+        }
+
+        for (int threads : bench.threads) {
+            RawTopic frameTopic = ntTable->GetRawTopic("/frame");
+            auto source = make_unique<MemorySource>(&images, frameCount, truths.empty() ? nullptr : &scaledTruths);
+            Camera camera(0, std::move(source), cameraMatrix, cameraConfig.distCoeffs,
+                frameTopic.Publish(frameRecordType), fieldLayout.empty() ? nullptr : &fieldLayout,
+                detector.tagSizeMeters, detector.detectParams, dict, threads, threads, detector.maxTagsPerFrame,
+                detector.tracking, detector.decimation, detector.threshold);
+
+            StageLog stageLog(frameCount, detector.maxTagsPerFrame);
+            camera.setStageLog(&stageLog);
+
+            int64_t cpuStart = processCpuMicros();
+            auto wallStart = chrono::steady_clock::now();
+
+            camera.startCapture(placements.capture);
+
+            {
+                // Every iteration claims exactly one frame, so one task per frame drains the source.
+                BS::thread_pool threadPool(threads, [&placements] {
+                    int worker = static_cast<int>(BS::this_thread::get_index().value());
+                    Trace::nameThread("worker " + to_string(worker));
+                    placements.workers.apply("worker", worker);
+                });
+                camera.setTilePool(&threadPool);
+
+                for (int i = 0; i < frameCount; i++) {
+                    threadPool.detach_task([&camera] {
+                        camera.runIteration();
+                    });
+                }
+                threadPool.wait();
+            }
+
+            camera.joinCapture();
+
+            auto wallElapsed = chrono::steady_clock::now() - wallStart;
+            int64_t wallMicros = chrono::duration_cast<chrono::microseconds>(wallElapsed).count();
+            int64_t cpuMicros = processCpuMicros() - cpuStart;
+
+            int64_t firstStart = INT64_MAX;
+            int64_t lastPublish = INT64_MIN;
+            int framesWithTags = 0;
+            for (int i = warmupFrames; i < stageLog.size(); i++) {
+                firstStart = min(firstStart, stageLog[i].started.wall);
+                lastPublish = max(lastPublish, stageLog[i].published.wall);
+                framesWithTags += stageLog[i].tagCount > 0 ? 1 : 0;
+            }
+
+            int measuredFrames = max(0, stageLog.size() - warmupFrames);
+
+            nlohmann::json run;
+            run["width"] = size.width;
+            run["height"] = size.height;
+            run["threads"] = threads;
+            run["frames"] = measuredFrames;
+            run["fps"] = measuredFrames > 0 && lastPublish > firstStart ?
+                measuredFrames * 1e6 / static_cast<double>(lastPublish - firstStart) : 0.0;
+            run["framesWithTags"] = framesWithTags;
+            run["cpuPercent"] = wallMicros > 0 ? 100.0 * cpuMicros / wallMicros : 0.0;
+
+            run["stages"]["wait"] = summarizeStage(stageLog, warmupFrames,
+                [](const StageTimings& t) { return t.claimed.wall - t.started.wall; },
+                [](const StageTimings& t) { return t.claimed.cpu - t.started.cpu; });
+            run["stages"]["detect"] = summarizeStage(stageLog, warmupFrames,
+                [](const StageTimings& t) { return t.detected.wall - t.claimed.wall; },
+                [](const StageTimings& t) { return t.detected.cpu - t.claimed.cpu; });
+            run["stages"]["pose"] = summarizeStage(stageLog, warmupFrames,
+                [](const StageTimings& t) { return t.solved.wall - t.detected.wall; },
+                [](const StageTimings& t) { return t.solved.cpu - t.detected.cpu; });
+            run["stages"]["publish"] = summarizeStage(stageLog, warmupFrames,
+                [](const StageTimings& t) { return t.published.wall - t.solved.wall; },
+                [](const StageTimings& t) { return t.published.cpu - t.solved.cpu; });
+            run["stages"]["total"] = summarizeStage(stageLog, warmupFrames,
+                [](const StageTimings& t) { return t.published.wall - t.captured; },
+                [](const StageTimings& t) { return t.published.cpu - t.started.cpu; });
+
+            if (!truths.empty()) {
+                run["accuracy"] = summarizeAccuracy(stageLog, warmupFrames, scaledTruths);
+            }
+
+            results["runs"].push_back(run);
+        }
+    }
+
+    if (argc > 2) {
+        ofstream resultsJSON(argv[2]);
+        resultsJSON << results.dump(4) << endl;
+    } else {
+        cout << results.dump(4) << endl;
+    }
+
+    NetworkTableInstance::Destroy(ntInst);
+
+    if (tracing) {
+        Trace::dump(config.trace.path);
+    }
+
+    Log::flush();
+}
@@ -1,30 +1,35 @@
 #include "Camera.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <memory>
 #include <string>
+#include <thread>
 
 #include <opencv2/core/matx.hpp>
 #include <opencv2/opencv.hpp>
 #include <utility>
 
 #include <ntcore/networktables/NetworkTableInstance.h>
-#include <ntcore/networktables/DoubleArrayTopic.h>
-#include <ntcore/networktables/IntegerTopic.h>
+#include <ntcore/networktables/RawTopic.h>
 
+#include "FrameRecord.h"
+#include "Log.h"
 #include "Utils.h"
 
 using namespace std;
 using namespace cv;
 using namespace nt;
 
-Camera::Camera(string& id, vector<vector<double>> matrix, vector<double> distortionCoefficents, vector<int> resolution,
-    int fps, DoubleArrayPublisher tvecOut, DoubleArrayPublisher rmatOut, IntegerPublisher idOut, Mat objectPoints,
-    aruco::DetectorParameters detectParams, aruco::Dictionary dict, int totalThreads, int maxTagSightings):
-threadset(totalThreads, maxTagSightings) {
-    camera.open(id);
-
-    camera.set(CAP_PROP_FRAME_WIDTH, resolution[0]);
-    camera.set(CAP_PROP_FRAME_HEIGHT, resolution[1]);
-    camera.set(CAP_PROP_FPS, fps);
+Camera::Camera(int index, unique_ptr<FrameSource> source, vector<vector<double>> matrix,
+    vector<double> distortionCoefficents, RawPublisher frameOut, const FieldLayout* fieldLayout, double tagSizeMeters,
+    aruco::DetectorParameters detectParams, aruco::Dictionary dict, int totalThreads, int maxWorkers,
+    int maxTagsPerFrame, TrackingParameters trackingParams, int decimation,
+    ThresholdParameters thresholdParams) {
+    this->index = index;
+    this->source = move(source);
 
     this->matrix = Mat::zeros(3, 3, DataType<double>::type);
 
@@ -40,94 +45,385 @@ threadset(totalThreads, maxTagSightings) {
         this->distortionCoefficients.at<double>(a) = distortionCoefficents[a];
     }
 
-    this->objectPoints = move(objectPoints);
+    poseSolver = make_unique<PoseSolver>(this->matrix, this->distortionCoefficients, tagSizeMeters);
 
-    this->tvecOut = move(tvecOut);
-    this->rmatOut = move(rmatOut);
-    this->idOut = move(idOut);
+    this->frameOut = move(frameOut);
 
-    camMutex = new mutex();
-    comMutex = new mutex();
-}
+    this->fieldLayout = fieldLayout;
 
-vector<Apriltag> Camera::findTags(Mat& image, aruco::ArucoDetector& detector) {
-    vector<vector<Point2f>> corners;
-    vector<int> ids;
-    vector<vector<Point2f>> rejectedCorners;
+    this->decimation = decimation;
+    this->simdThreshold = thresholdParams.simd;
 
-    detector.detectMarkers(image, corners, ids, rejectedCorners);
+    stageLog = nullptr;
+    tilePool = nullptr;
 
-    vector<Apriltag> apriltags;
-    cout << ids.size() << endl;
-    for (int a = 0; a < ids.size(); a++) {
-        apriltags.emplace_back(corners[a], ids[a]);
+    maxFrameAgeMicros = 0;
+    staleFrames = make_unique<atomic<uint64_t>>(0);
+
+    // With decimation, or ThresholdDetector, the detector only finds quads; corners are refined at full resolution in
+    // detectRegion.
+    if (decimation > 1 || thresholdParams.simd) {
+        detectParams.cornerRefinementMethod = aruco::CORNER_REFINE_NONE;
     }
 
-    return apriltags;
+    threadset = make_unique<CameraThreadset>(totalThreads);
+
+    frames = make_unique<FrameSlot>(maxWorkers);
+    detectors = make_unique<DetectorPool>(dict, detectParams, thresholdParams, maxWorkers, maxTagsPerFrame);
+    tracker = make_unique<TagTracker>(trackingParams, maxTagsPerFrame);
 }
 
-Pose Camera::findRelativePose(const Apriltag& apriltag) {
-    Mat rvec(3,1,DataType<double>::type), tvec(3,1,DataType<double>::type);
+void Camera::startCapture(ThreadPlacement placement) {
+    captureThread = thread([this, placement] {
+        placement.apply("capture", index);
+        captureLoop();
+    });
+}
+
+void Camera::joinCapture() {
+    captureThread.join();
+}
 
-    solvePnP(objectPoints, apriltag.corners, matrix, distortionCoefficients,
-        rvec, tvec, false, SOLVEPNP_IPPE_SQUARE);
+void Camera::setStageLog(StageLog* stageLog) {
+    this->stageLog = stageLog;
+}
 
-    Mat rmat(3,3,DataType<double>::type);
+void Camera::setTilePool(BS::thread_pool* tilePool) {
+    this->tilePool = tilePool;
+}
 
-    Rodrigues(rvec, rmat);
+void Camera::setMaxFrameAge(int64_t maxFrameAgeMicros) {
+    this->maxFrameAgeMicros = maxFrameAgeMicros;
+}
 
-    transpose(rmat, rmat);
-    tvec = -rmat * tvec;
+FrameCounts Camera::frameCounts() const {
+    FrameCounts counts;
+    counts.captured = frames->latestSequence();
+    counts.superseded = frames->skippedFrames();
+    counts.stale = staleFrames->load(memory_order_relaxed);
+    counts.sourceDropped = source->droppedFrames();
 
-    return Pose(tvec, rmat);
+    return counts;
 }
 
-aruco::ArucoDetector Camera::runIteration(aruco::ArucoDetector detector) {
-    cout << "Run iteration called" << endl;
-    Mat image;
+void Camera::captureLoop() {
+    Trace::nameThread("camera " + to_string(index) + " capture");
 
-    unique_lock<mutex> imageLock(*camMutex);
-    camera.read(image);
-    imageLock.unlock();
+    while (true) {
+        if (!source->paced()) {
+            frames->waitForClaimed();
+        }
 
-    if(image.empty()) {
-        cout << "Bad" << endl;
-        return detector;
+        TraceSpan captureSpan("capture", index);
+
+        Frame& frame = frames->beginWrite();
+
+        if (!source->read(frame.image, frame.timestamp) || frame.image.empty()) {
+            if (source->exhausted()) {
+                return;
+            }
+
+            LOG_WARNING("Camera %d failed to read a frame", index);
+            this_thread::sleep_for(chrono::milliseconds(10));
+            continue;
+        }
+
+        frames->commitWrite();
+        captureSpan.setFrame(static_cast<int64_t>(frame.sequence));
     }
+}
 
-    int64_t timestamp = nt::Now();
+static void collectTags(FrameScratch& scratch, Point2f offset) {
+    for (int a = 0; a < scratch.ids.size(); a++) {
+        auto end = scratch.apriltags.begin() + scratch.tagCount;
+        int id = scratch.ids[a];
+        if (any_of(scratch.apriltags.begin(), end, [id](const Apriltag& apriltag) { return apriltag.id == id; })) {
+            continue;
+        }
 
-    vector<Apriltag> apriltags = findTags(image, detector);
+        if (scratch.apriltags.size() <= scratch.tagCount) {
+            scratch.apriltags.resize(scratch.tagCount + 1);
+        }
 
-    for (const Apriltag& apriltag : apriltags) {
-        Pose pose = findRelativePose(apriltag);
+        Apriltag& apriltag = scratch.apriltags[scratch.tagCount];
+        for (int b = 0; b < 4; b++) {
+            apriltag.corners[b] = scratch.corners[a][b] + offset;
+        }
+        apriltag.id = id;
 
-        vector<double> tvec;
-        vector<double> rmat;
+        scratch.tagCount += 1;
+    }
+}
+
+// An integer factor's INTER_AREA resize, block averages, into a buffer reused across regions. Trailing pixels that
+// don't fill a block are dropped.
+static Mat decimate(const Mat& image, int factor, FrameScratch& scratch) {
+    Mat decimated = fitBuffer(scratch.decimatedBuffer, Size(image.cols / factor, image.rows / factor), CV_8UC1);
 
-        for(int a = 0; a < 3; a++) {
-            tvec.push_back(pose.tvec.at<double>(a));
-            for(int b = 0; b < 3; b++) {
-                rmat.push_back(pose.rmat.at<double>(a, b));
+    vector<int>& sums = scratch.decimateSums;
+    sums.resize(decimated.cols);
+    int area = factor * factor;
+
+    for (int y = 0; y < decimated.rows; y++) {
+        fill(sums.begin(), sums.end(), 0);
+
+        for (int row = y * factor; row < (y + 1) * factor; row++) {
+            const uchar* source = image.ptr<uchar>(row);
+            for (int x = 0; x < decimated.cols; x++) {
+                for (int k = 0; k < factor; k++) {
+                    sums[x] += source[x * factor + k];
+                }
             }
         }
 
-        tvecOut.Set(tvec, timestamp);
-        rmatOut.Set(rmat, timestamp);
-        idOut.Set(apriltag.id, timestamp);
+        uchar* target = decimated.ptr<uchar>(y);
+        for (int x = 0; x < decimated.cols; x++) {
+            target[x] = static_cast<uchar>((sums[x] + area / 2) / area);
+        }
+    }
+
+    return decimated;
+}
+
+// cornerSubPix for one corner, with its window buffers kept in scratch: moves the corner to where the image gradients
+// around it are all perpendicular to their offsets from it.
+static void refineCorner(const Mat& image, Point2f& corner, int halfWindow, const TermCriteria& criteria,
+    FrameScratch& scratch) {
+    int windowSize = 2 * halfWindow + 1;
+
+    // Gaussian weights, the same along both axes.
+    vector<float>& weights = scratch.refineWeights;
+    weights.resize(windowSize);
+    for (int i = 0; i < windowSize; i++) {
+        float x = static_cast<float>(i - halfWindow) / static_cast<float>(halfWindow);
+        weights[i] = exp(-x * x);
+    }
+
+    // A pixel more on each side for the central differences.
+    Mat patch = fitBuffer(scratch.refineBuffer, Size(windowSize + 2, windowSize + 2), CV_32FC1);
+
+    int maxIterations = min(max(criteria.maxCount, 1), 100);
+    double epsilonSquared = criteria.epsilon * criteria.epsilon;
+
+    Point2f start = corner;
+    Point2f current = corner;
+
+    for (int iteration = 0; iteration < maxIterations; iteration++) {
+        getRectSubPix(image, patch.size(), current, patch, CV_32F);
+
+        double a = 0, b = 0, c = 0, bb1 = 0, bb2 = 0;
+        for (int i = 0; i < windowSize; i++) {
+            const float* above = patch.ptr<float>(i);
+            const float* middle = patch.ptr<float>(i + 1);
+            const float* below = patch.ptr<float>(i + 2);
+            double py = i - halfWindow;
+
+            for (int j = 0; j < windowSize; j++) {
+                double weight = weights[i] * weights[j];
+                double gx = middle[j + 2] - middle[j];
+                double gy = below[j + 1] - above[j + 1];
+                double px = j - halfWindow;
+
+                a += gx * gx * weight;
+                b += gx * gy * weight;
+                c += gy * gy * weight;
+                bb1 += (gx * gx * px + gx * gy * py) * weight;
+                bb2 += (gx * gy * px + gy * gy * py) * weight;
+            }
+        }
+
+        double det = a * c - b * b;
+        if (abs(det) <= DBL_EPSILON * DBL_EPSILON) {
+            break;
+        }
+
+        Point2f next(static_cast<float>(current.x + (c * bb1 - b * bb2) / det),
+            static_cast<float>(current.y + (a * bb2 - b * bb1) / det));
+        Point2f shift = next - current;
+        current = next;
+
+        if (current.x < 0 || current.x >= image.cols || current.y < 0 || current.y >= image.rows ||
+            shift.dot(shift) <= epsilonSquared) {
+            break;
+        }
+    }
+
+    // Ending up outside the window means it locked onto something else.
+    if (abs(current.x - start.x) > halfWindow || abs(current.y - start.y) > halfWindow) {
+        current = start;
+    }
+
+    corner = current;
+}
+
+void Camera::detectRegion(const Mat& image, Rect region, PooledDetector& worker) {
+    FrameScratch& scratch = worker.scratch;
+    Mat view = image(region);
+
+    const Mat* detectImage = &view;
+    Mat decimated;
+    if (decimation > 1) {
+        decimated = decimate(view, decimation, scratch);
+        detectImage = &decimated;
+    }
+
+    if (simdThreshold) {
+        worker.thresholdDetector.detectMarkers(*detectImage, scratch.corners, scratch.ids, tilePool);
+    } else {
+        worker.detector.detectMarkers(*detectImage, scratch.arucoCorners, scratch.ids);
+
+        scratch.corners.clear();
+        for (const vector<Point2f>& corners : scratch.arucoCorners) {
+            scratch.corners.push_back({corners[0], corners[1], corners[2], corners[3]});
+        }
+    }
+
+    // Only an undecimated ArucoDetector refines its own corners.
+    if (decimation == 1 && !simdThreshold) {
+        collectTags(scratch, Point2f(static_cast<float>(region.x), static_cast<float>(region.y)));
+        return;
+    }
+
+    const aruco::DetectorParameters& params = worker.detector.getDetectorParameters();
+    int modulesPerSide = worker.detector.getDictionary().markerSize + 2 * params.markerBorderBits;
+    TermCriteria criteria(TermCriteria::MAX_ITER | TermCriteria::EPS, params.cornerRefinementMaxIterations,
+        params.cornerRefinementMinAccuracy);
+
+    for (array<Point2f, 4>& corners : scratch.corners) {
+        float perimeter = 0;
+        for (int a = 0; a < 4; a++) {
+            // Map decimated pixel centers back onto full resolution pixel centers.
+            corners[a] = (corners[a] + Point2f(0.5f, 0.5f)) * static_cast<float>(decimation) - Point2f(0.5f, 0.5f);
+        }
+        for (int a = 0; a < 4; a++) {
+            perimeter += static_cast<float>(norm(corners[a] - corners[(a + 1) % 4]));
+        }
+
+        // The decimated corner is off by about one decimated pixel, but the window must stay inside the tag's border
+        // module or it will lock onto a neighboring corner.
+        float moduleSize = perimeter / 4.f / static_cast<float>(modulesPerSide);
+        int halfWindow = max(2, min(2 * decimation,
+            static_cast<int>(params.relativeCornerRefinmentWinSize * moduleSize)));
+
+        for (Point2f& corner : corners) {
+            refineCorner(view, corner, halfWindow, criteria, scratch);
+        }
+    }
+
+    collectTags(scratch, Point2f(static_cast<float>(region.x), static_cast<float>(region.y)));
+}
+
+void Camera::findTags(const Mat& image, int64_t timestamp, PooledDetector& worker) {
+    FrameScratch& scratch = worker.scratch;
+    scratch.tagCount = 0;
+
+    // Sources deliver grayscale unless color was asked for. Detection and refinement only ever see one channel, so a
+    // color frame is converted once here rather than by detectMarkers in every region.
+    const Mat* source = &image;
+    if (image.channels() != 1) {
+        cvtColor(image, scratch.gray, COLOR_BGR2GRAY);
+        source = &scratch.gray;
+    }
+
+    bool fullSearch = !tracker->predict(timestamp, image.size(), scratch.rois);
+
+    if (!fullSearch) {
+        for (const Rect& roi : scratch.rois) {
+            detectRegion(*source, roi, worker);
+        }
+
+        // Every tracked tag vanished; don't wait for the next scheduled full search.
+        fullSearch = scratch.tagCount == 0;
+    }
+
+    if (fullSearch) {
+        detectRegion(*source, Rect(0, 0, image.cols, image.rows), worker);
+    }
+
+    LOG_DEBUG("Camera %d found %d tags", index, scratch.tagCount);
+
+    tracker->update(scratch.apriltags, scratch.tagCount, timestamp, fullSearch);
+}
+
+void Camera::runIteration() {
+    StageTimings timings;
+    if (stageLog != nullptr) {
+        timings.started = StageMark::now();
+    }
+
+    TraceSpan claimSpan("claim", index);
+
+    PooledDetector* worker = detectors->checkOut();
+    FrameScratch& scratch = worker->scratch;
+
+    FrameLease frame;
+    while (true) {
+        frame = frames->claimLatest();
+        while (!frame) {
+            frames->waitForUnclaimed();
+            frame = frames->claimLatest();
+        }
+
+        // A late pose is worse than none, so rather than spend the iteration on a stale frame, wait for the next one.
+        if (maxFrameAgeMicros <= 0 || nt::Now() - frame->timestamp <= maxFrameAgeMicros) {
+            break;
+        }
+
+        staleFrames->fetch_add(1, memory_order_relaxed);
+        frame.release();
+    }
+
+    uint64_t frameSequence = frame->sequence;
+    int64_t timestamp = frame->timestamp;
+
+    int64_t workStart = nt::Now();
+
+    if (stageLog != nullptr) {
+        timings.sequence = frameSequence;
+        timings.captured = timestamp;
+        timings.claimed = StageMark::now();
+    }
+
+    claimSpan.setFrame(static_cast<int64_t>(frameSequence));
+    claimSpan.end();
+
+    TraceSpan detectSpan("detect", index, static_cast<int64_t>(frameSequence));
+    findTags(frame->image, timestamp, *worker);
+    frame.release();
+    detectSpan.end();
+
+    if (stageLog != nullptr) {
+        timings.detected = StageMark::now();
+        timings.tagCount = scratch.tagCount;
+    }
+
+    TraceSpan poseSpan("pose", index, static_cast<int64_t>(frameSequence));
+    poseSolver->solve(scratch);
+
+    scratch.fieldTagCount = 0;
+    if (fieldLayout != nullptr) {
+        poseSolver->solveField(*fieldLayout, scratch);
+    }
+    poseSpan.end();
+
+    if (stageLog != nullptr) {
+        timings.solved = StageMark::now();
     }
 
-    unique_lock<mutex> lock(*comMutex);
+    // Published even with no tags solved, so consumers see the camera is alive and that there's nothing in view.
+    TraceSpan publishSpan("publish", index, static_cast<int64_t>(frameSequence));
+    writeFrameRecord(scratch, frameSequence, timestamp, nt::Now() - timestamp, scratch.record);
+    frameOut.Set(scratch.record, timestamp);
+    publishSpan.end();
 
-    if (!apriltags.empty() && threadset.tagSightings < threadset.maxTagSightings) {
-        threadset.tagSightings += 1;
-    } else if (apriltags.empty() && threadset.tagSightings != 0) {
-        threadset.tagSightings -= 1;
+    if (stageLog != nullptr) {
+        timings.published = StageMark::now();
+        stageLog->record(timings, scratch);
     }
 
-    threadset.activeThreads -= 1;
+    int64_t busyMicros = nt::Now() - workStart;
 
-    lock.unlock();
+    threadset->recordIteration(scratch.tagCount > 0, busyMicros);
 
-    return detector;
+    detectors->checkIn(worker);
 }
@@ -1,47 +1,103 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
-#include <mutex>
+#include <thread>
+#include <type_traits>
 
 #include <opencv2/opencv.hpp>
 
 #include <ntcore/networktables/NetworkTableInstance.h>
-#include <ntcore/networktables/DoubleArrayTopic.h>
-#include <ntcore/networktables/IntegerTopic.h>
+#include <ntcore/networktables/RawTopic.h>
 
+#include "DetectorPool.h"
+#include "FieldLayout.h"
+#include "FrameSlot.h"
+#include "FrameSource.h"
+#include "PoseSolver.h"
+#include "StageLog.h"
+#include "TagTracker.h"
+#include "ThreadPlacement.h"
+#include "Trace.h"
 #include "Utils.h"
 
+// What happened to a camera's frames since it started.
+struct FrameCounts {
+    uint64_t captured;
+    // Replaced in the frame slot by a newer frame before any worker was free for them.
+    uint64_t superseded;
+    // Claimed, but already older than the age budget.
+    uint64_t stale;
+    // Thrown away by the source in favor of a newer frame.
+    uint64_t sourceDropped;
+};
+
 class Camera {
     public:
-        Camera(std::string& id, std::vector<std::vector<double>> matrix, std::vector<double> distortionCoefficents,
-            std::vector<int> resolution, int fps, nt::DoubleArrayPublisher tvecOut,nt::DoubleArrayPublisher rmatOut,
-            nt::IntegerPublisher idOut, cv::Mat objectPoints, cv::aruco::DetectorParameters detectParams,
-            cv::aruco::Dictionary dictionary, int totalThreads, int maxTagSightings);
+        Camera(int index, std::unique_ptr<FrameSource> source, std::vector<std::vector<double>> matrix, std::vector<double> distortionCoefficents,
+            nt::RawPublisher frameOut, const FieldLayout* fieldLayout, double tagSizeMeters, cv::aruco::DetectorParameters detectParams,
+            cv::aruco::Dictionary dictionary, int totalThreads, int maxWorkers,
+            int maxTagsPerFrame, TrackingParameters trackingParams, int decimation,
+            ThresholdParameters thresholdParams);
+
+        void startCapture(ThreadPlacement placement = ThreadPlacement());
+        // Only returns once the source is exhausted.
+        void joinCapture();
+
+        // Benchmarks attach a log to get per-stage timings of every iteration.
+        void setStageLog(StageLog* stageLog);
+
+        // The pool a frame's detection tiles run on, when thresholdParams asks for more than one.
+        void setTilePool(BS::thread_pool* tilePool);
+
+        // Frames older than this when claimed are dropped instead of detected; 0 keeps every frame.
+        void setMaxFrameAge(int64_t maxFrameAgeMicros);
 
-        cv::aruco::ArucoDetector runIteration(cv::aruco::ArucoDetector detector);
+        FrameCounts frameCounts() const;
 
-        CameraThreadset threadset;
+        void runIteration();
 
-        std::mutex* camMutex;
-        std::mutex* comMutex;
+        // Held by pointer, as it's atomic and cameras live in a vector.
+        std::unique_ptr<CameraThreadset> threadset;
     private:
-        cv::VideoCapture camera;
+        int index;
+        std::unique_ptr<FrameSource> source;
+        std::thread captureThread;
+        std::unique_ptr<FrameSlot> frames;
+        std::unique_ptr<DetectorPool> detectors;
+        std::unique_ptr<TagTracker> tracker;
         cv::Mat matrix;
         cv::Mat distortionCoefficients;
 
-        cv::Mat objectPoints;
+        std::unique_ptr<PoseSolver> poseSolver;
 
-        nt::DoubleArrayPublisher tvecOut;
-        nt::DoubleArrayPublisher rmatOut;
-        nt::IntegerPublisher idOut;
+        int decimation;
+        // Detect with ThresholdDetector instead of ArucoDetector.
+        bool simdThreshold;
 
-        std::vector<Apriltag> findTags(cv::Mat& image,cv::aruco::ArucoDetector&);
+        nt::RawPublisher frameOut;
 
-        Pose findRelativePose(const Apriltag& apriltag);
+        const FieldLayout* fieldLayout;
+
+        StageLog* stageLog;
+        BS::thread_pool* tilePool;
+
+        int64_t maxFrameAgeMicros;
+        std::unique_ptr<std::atomic<uint64_t>> staleFrames;
+
+        void captureLoop();
+
+        void detectRegion(const cv::Mat& image, cv::Rect region, PooledDetector& worker);
+
+        void findTags(const cv::Mat& image, int64_t timestamp, PooledDetector& worker);
 };
 
+// Cameras are built in place in a vector, so they must stay movable until their capture thread starts.
+static_assert(std::is_move_constructible_v<Camera>);
+
 
 
 #endif //CAMERA_H
@@ -0,0 +1,29 @@
+#include "CompletionQueue.h"
+
+#include <chrono>
+
+using namespace std;
+
+CompletionQueue::CompletionQueue() {
+    this->pending = 0;
+}
+
+void CompletionQueue::push() {
+    unique_lock<mutex> lock(queueMutex);
+    pending += 1;
+    lock.unlock();
+
+    queueCondition.notify_one();
+}
+
+void CompletionQueue::waitFor(int64_t timeoutMicros) {
+    unique_lock<mutex> lock(queueMutex);
+
+    if (timeoutMicros < 0) {
+        queueCondition.wait(lock, [this] { return pending > 0; });
+    } else if (timeoutMicros > 0) {
+        queueCondition.wait_for(lock, chrono::microseconds(timeoutMicros), [this] { return pending > 0; });
+    }
+
+    pending = 0;
+}
@@ -0,0 +1,24 @@
+#ifndef COMPLETIONQUEUE_H
+#define COMPLETIONQUEUE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Signalled by finished runIteration tasks so the dispatcher in main() can sleep until there is work.
+class CompletionQueue {
+    public:
+        CompletionQueue();
+
+        void push();
+
+        // Blocks for up to timeoutMicros (forever if negative) or until a completion arrives, then clears all pending
+        // completions.
+        void waitFor(int64_t timeoutMicros);
+    private:
+        std::mutex queueMutex;
+        std::condition_variable queueCondition;
+        int pending;
+};
+
+#endif //COMPLETIONQUEUE_H
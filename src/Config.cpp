@@ -0,0 +1,782 @@
+#include "Config.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+
+#include "../include/json.hpp"
+
+#include "Log.h"
+#include "Setup.h"
+
+using namespace std;
+
+enum class FieldType {
+    Number,
+    Integer,
+    Boolean,
+    String,
+    Object,
+    Any
+};
+
+struct Field {
+    const char* key;
+    FieldType type;
+    bool required;
+};
+
+static const vector<string> sourceTypes = {"device", "v4l2", "video", "images", "log", "synthetic"};
+
+// Backends that open a live camera. Recorded and synthetic frames only come from a "replay" object or bench.json, so a
+// copied-in replay type can't stand in for a real camera.
+static const vector<string> cameraBackends = {"device", "v4l2"};
+
+static const vector<Field> cameraFields = {
+    {"id", FieldType::String, true},
+    {"enabled", FieldType::Boolean, false},
+    {"backend", FieldType::String, false},
+    {"pixelFormat", FieldType::String, false},
+    {"color", FieldType::Boolean, false},
+    {"maxFrameAgeMilliseconds", FieldType::Number, false},
+    {"matrix", FieldType::Object, true},
+    {"distCoeffs", FieldType::Object, true},
+    {"frameWidth", FieldType::Integer, true},
+    {"frameHeight", FieldType::Integer, true},
+    {"fps", FieldType::Number, true},
+    {"replay", FieldType::Object, false}
+};
+
+static const vector<Field> matrixFields = {
+    {"fx", FieldType::Number, true},
+    {"fy", FieldType::Number, true},
+    {"cx", FieldType::Number, true},
+    {"cy", FieldType::Number, true}
+};
+
+static const vector<Field> distCoeffFields = {
+    {"k1", FieldType::Number, true},
+    {"k2", FieldType::Number, true},
+    {"p1", FieldType::Number, true},
+    {"p2", FieldType::Number, true},
+    {"k3", FieldType::Number, true}
+};
+
+static const vector<Field> replayFields = {
+    {"type", FieldType::String, true},
+    {"path", FieldType::String, false},
+    {"realtime", FieldType::Boolean, false},
+    {"loop", FieldType::Boolean, false},
+    {"fps", FieldType::Number, false},
+    {"scene", FieldType::Object, false}
+};
+
+static const vector<Field> sceneFields = {
+    {"width", FieldType::Integer, false},
+    {"height", FieldType::Integer, false},
+    {"tagSizeMeters", FieldType::Number, false},
+    {"quietModules", FieldType::Integer, false},
+    {"tagCount", FieldType::Integer, false},
+    {"maxTagId", FieldType::Integer, false},
+    {"minDistance", FieldType::Number, false},
+    {"maxDistance", FieldType::Number, false},
+    {"maxTiltDegrees", FieldType::Number, false},
+    {"maxRollDegrees", FieldType::Number, false},
+    {"background", FieldType::Integer, false},
+    {"blurSigma", FieldType::Number, false},
+    {"noiseSigma", FieldType::Number, false},
+    {"seed", FieldType::Integer, false}
+};
+
+static const vector<Field> detectorFields = {
+    {"tagSizeMeters", FieldType::Number, true},
+    {"maxTagsPerFrame", FieldType::Integer, true},
+    {"decimation", FieldType::Integer, true},
+    {"fieldLayout", FieldType::String, true},
+    {"adaptiveThreshWinMin", FieldType::Integer, true},
+    {"adaptiveThreshWinMax", FieldType::Integer, true},
+    {"adaptiveThreshWinStep", FieldType::Integer, true},
+    {"thresholdBackend", FieldType::String, true},
+    {"detectionTiles", FieldType::Integer, true},
+    {"detectionTileOverlap", FieldType::Number, true},
+    {"minMarkerPerimiterRate", FieldType::Number, true},
+    {"maxMarkerPerimiterRate", FieldType::Number, true},
+    {"minMarkerDistanceRate", FieldType::Number, true},
+    {"minDistanceToBorder", FieldType::Integer, true},
+    {"perspectiveRemovePixelPerCell", FieldType::Integer, true},
+    {"perspectiveRemoveIgnoredMarginPerCell", FieldType::Number, true},
+    {"maxErroneousBitsInBorderRate", FieldType::Number, true},
+    {"errorCorrectionRate", FieldType::Number, true},
+    {"relativeCornerRefinmentWinSize", FieldType::Number, true},
+    {"cornerRefinementMaxIterations", FieldType::Integer, true},
+    {"cornerRefinementMinAccuracy", FieldType::Number, true},
+    {"trackingEnabled", FieldType::Boolean, true},
+    {"trackingFullSearchInterval", FieldType::Integer, true},
+    {"trackingRoiPadding", FieldType::Number, true},
+    {"trackingMinRoiPaddingPixels", FieldType::Integer, true},
+    {"trackingTimeoutMilliseconds", FieldType::Integer, true}
+};
+
+static const vector<Field> threadingFields = {
+    {"totalThreads", FieldType::Integer, true},
+    {"defaultThreadsPerCamera", FieldType::Integer, true},
+    {"minThreadsPerCamera", FieldType::Integer, true},
+    {"minThreadOffsetMilliseconds", FieldType::Integer, true},
+    {"allocationIntervalMilliseconds", FieldType::Integer, true},
+    {"allocationSmoothing", FieldType::Number, true},
+    {"allocationExplorationWeight", FieldType::Number, true},
+    {"allocationFrameRateHeadroom", FieldType::Number, true},
+    {"placement", FieldType::Object, false}
+};
+
+static const vector<Field> placementFields = {
+    {"dispatcher", FieldType::Object, false},
+    {"capture", FieldType::Object, false},
+    {"workers", FieldType::Object, false},
+    {"publisher", FieldType::Object, false}
+};
+
+static const vector<Field> threadPlacementFields = {
+    {"cores", FieldType::Any, false},
+    {"pinEach", FieldType::Boolean, false},
+    {"policy", FieldType::String, false},
+    {"priority", FieldType::Integer, false},
+    {"nice", FieldType::Integer, false}
+};
+
+static const vector<Field> networkTablesFields = {
+    {"teamNumber", FieldType::Integer, true}
+};
+
+static const vector<Field> traceFields = {
+    {"enabled", FieldType::Boolean, true},
+    {"eventsPerThread", FieldType::Integer, true},
+    {"path", FieldType::String, true}
+};
+
+// WPILib's AprilTagFieldLayout format.
+static const vector<Field> fieldLayoutFields = {
+    {"tags", FieldType::Any, true},
+    {"field", FieldType::Object, false}
+};
+
+static const vector<Field> fieldSizeFields = {
+    {"length", FieldType::Number, true},
+    {"width", FieldType::Number, true}
+};
+
+static const vector<Field> fieldTagFields = {
+    {"ID", FieldType::Integer, true},
+    {"pose", FieldType::Object, true}
+};
+
+static const vector<Field> tagPoseFields = {
+    {"translation", FieldType::Object, true},
+    {"rotation", FieldType::Object, true}
+};
+
+static const vector<Field> translationFields = {
+    {"x", FieldType::Number, true},
+    {"y", FieldType::Number, true},
+    {"z", FieldType::Number, true}
+};
+
+static const vector<Field> rotationFields = {
+    {"quaternion", FieldType::Object, true}
+};
+
+static const vector<Field> quaternionFields = {
+    {"W", FieldType::Number, true},
+    {"X", FieldType::Number, true},
+    {"Y", FieldType::Number, true},
+    {"Z", FieldType::Number, true}
+};
+
+static const vector<Field> benchFields = {
+    {"camera", FieldType::Integer, true},
+    {"source", FieldType::Object, false},
+    {"preloadFrames", FieldType::Integer, true},
+    {"frames", FieldType::Integer, true},
+    {"warmupFrames", FieldType::Integer, true},
+    {"threads", FieldType::Any, true},
+    {"resolutions", FieldType::Any, true}
+};
+
+static const vector<Field> benchSourceFields = {
+    {"type", FieldType::String, true},
+    {"path", FieldType::String, false},
+    {"fps", FieldType::Number, false},
+    {"scene", FieldType::Object, false}
+};
+
+DetectorConfig::DetectorConfig() {
+    this->tagSizeMeters = 0;
+    this->maxTagsPerFrame = 0;
+    this->decimation = 1;
+}
+
+ThreadingConfig::ThreadingConfig() {
+    this->totalThreads = 1;
+    this->defaultThreadsPerCamera = 1;
+    this->minThreadOffsetMicros = 0;
+}
+
+NetworkTablesConfig::NetworkTablesConfig() {
+    this->teamNumber = 0;
+}
+
+TraceConfig::TraceConfig() {
+    this->enabled = false;
+    this->eventsPerThread = 0;
+}
+
+BenchConfig::BenchConfig() {
+    this->camera = 0;
+    this->frames = 0;
+    this->warmupFrames = 0;
+    this->preloadFrames = 0;
+}
+
+static bool hasType(const nlohmann::json& value, FieldType type) {
+    switch (type) {
+        case FieldType::Number: return value.is_number();
+        case FieldType::Integer: return value.is_number_integer();
+        case FieldType::Boolean: return value.is_boolean();
+        case FieldType::String: return value.is_string();
+        case FieldType::Object: return value.is_object();
+        default: return true;
+    }
+}
+
+static const char* typeName(FieldType type) {
+    switch (type) {
+        case FieldType::Number: return "a number";
+        case FieldType::Integer: return "an integer";
+        case FieldType::Boolean: return "true or false";
+        case FieldType::String: return "a string";
+        case FieldType::Object: return "an object";
+        default: return "anything";
+    }
+}
+
+static string number(double value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%g", value);
+    return text;
+}
+
+static bool readFile(const string& path, nlohmann::json& contents, vector<string>& errors) {
+    ifstream file(path);
+    if (!file) {
+        errors.push_back(path + " can't be opened");
+        return false;
+    }
+
+    try {
+        contents = nlohmann::json::parse(file);
+    } catch (const nlohmann::json::parse_error& error) {
+        errors.push_back(path + ": " + error.what());
+        return false;
+    }
+
+    if (!contents.is_object()) {
+        errors.push_back(path + " isn't a JSON object");
+        return false;
+    }
+
+    return true;
+}
+
+// Reports missing keys, keys of the wrong type and keys nothing reads, which are most often typos or settings put in
+// the wrong object.
+static void checkFields(const nlohmann::json& object, const string& where, const vector<Field>& fields,
+    vector<string>& errors) {
+    for (const Field& field : fields) {
+        if (!object.contains(field.key)) {
+            if (field.required) {
+                errors.push_back(where + " is missing \"" + field.key + "\"");
+            }
+        } else if (!hasType(object[field.key], field.type)) {
+            errors.push_back(where + "." + field.key + " should be " + typeName(field.type));
+        }
+    }
+
+    for (auto& item : object.items()) {
+        bool known = false;
+        for (const Field& field : fields) {
+            known = known || item.key() == field.key;
+        }
+
+        if (!known) {
+            errors.push_back(where + " has unknown key \"" + item.key() + "\"");
+        }
+    }
+}
+
+// For checks comparing fields, which only run once both have passed checkFields.
+static bool isInteger(const nlohmann::json& object, const char* key) {
+    return object.contains(key) && object[key].is_number_integer();
+}
+
+// Range checks skip values that are missing or of the wrong type; checkFields has reported those.
+static void checkRange(const nlohmann::json& object, const string& where, const char* key, double min, double max,
+    vector<string>& errors) {
+    if (!object.contains(key) || !object[key].is_number()) {
+        return;
+    }
+
+    double value = object[key];
+    if (value < min || value > max) {
+        errors.push_back(where + "." + key + " is " + number(value) + ", outside [" + number(min) + ", " + number(max) +
+            "]");
+    }
+}
+
+static void checkAtLeast(const nlohmann::json& object, const string& where, const char* key, double min,
+    vector<string>& errors) {
+    checkRange(object, where, key, min, numeric_limits<double>::infinity(), errors);
+}
+
+static void checkOneOf(const nlohmann::json& object, const string& where, const char* key,
+    const vector<string>& allowed, vector<string>& errors) {
+    if (!object.contains(key) || !object[key].is_string()) {
+        return;
+    }
+
+    string value = object[key];
+    if (find(allowed.begin(), allowed.end(), value) == allowed.end()) {
+        string choices;
+        for (const string& choice : allowed) {
+            choices += (choices.empty() ? "" : ", ") + choice;
+        }
+        errors.push_back(where + "." + key + " is \"" + value + "\", not one of " + choices);
+    }
+}
+
+static bool isEnabled(const nlohmann::json& camera) {
+    return !camera.contains("enabled") || !camera["enabled"].is_boolean() || camera["enabled"].get<bool>();
+}
+
+static void checkCameras(const nlohmann::json& camConfig, const string& path, vector<string>& errors) {
+    for (auto& item : camConfig.items()) {
+        if (item.key() == "Cameras") {
+            continue;
+        }
+
+        if (item.value().is_object() && item.value().contains("id")) {
+            errors.push_back(path + ": camera \"" + item.key() + "\" is outside \"Cameras\"");
+        } else {
+            errors.push_back(path + " has unknown key \"" + item.key() + "\"");
+        }
+    }
+
+    if (!camConfig.contains("Cameras") || !camConfig["Cameras"].is_object() || camConfig["Cameras"].empty()) {
+        errors.push_back(path + " has no \"Cameras\" object with a camera in it");
+        return;
+    }
+
+    // Which camera opened each device, to catch two opening the same one.
+    map<string, string> devices;
+    int enabledCount = 0;
+
+    for (auto& item : camConfig["Cameras"].items()) {
+        string where = path + " " + item.key();
+        const nlohmann::json& camera = item.value();
+
+        if (!camera.is_object()) {
+            errors.push_back(where + " isn't a camera; is a camera's setting outside its braces?");
+            continue;
+        }
+
+        enabledCount += isEnabled(camera) ? 1 : 0;
+
+        checkFields(camera, where, cameraFields, errors);
+        checkOneOf(camera, where, "backend", cameraBackends, errors);
+        checkOneOf(camera, where, "pixelFormat", {"YUYV", "MJPG"}, errors);
+        checkAtLeast(camera, where, "frameWidth", 1, errors);
+        checkAtLeast(camera, where, "frameHeight", 1, errors);
+        checkRange(camera, where, "fps", 1e-3, numeric_limits<double>::infinity(), errors);
+        checkAtLeast(camera, where, "maxFrameAgeMilliseconds", 0, errors);
+
+        if (camera.contains("matrix") && camera["matrix"].is_object()) {
+            checkFields(camera["matrix"], where + ".matrix", matrixFields, errors);
+        }
+        if (camera.contains("distCoeffs") && camera["distCoeffs"].is_object()) {
+            checkFields(camera["distCoeffs"], where + ".distCoeffs", distCoeffFields, errors);
+        }
+
+        bool replayed = camera.contains("replay") && camera["replay"].is_object();
+        if (replayed) {
+            const nlohmann::json& replay = camera["replay"];
+            checkFields(replay, where + ".replay", replayFields, errors);
+            checkOneOf(replay, where + ".replay", "type", sourceTypes, errors);
+
+            if (replay.contains("scene") && replay["scene"].is_object()) {
+                checkFields(replay["scene"], where + ".replay.scene", sceneFields, errors);
+            }
+        }
+
+        // A disabled camera is never opened, so it may name a device another camera uses.
+        if (isEnabled(camera) && !replayed && camera.contains("id") && camera["id"].is_string()) {
+            string device = camera["id"];
+            if (devices.count(device) > 0) {
+                errors.push_back(where + " opens " + device + ", already opened by " + devices[device]);
+            } else {
+                devices[device] = item.key();
+            }
+        }
+    }
+
+    if (enabledCount == 0) {
+        errors.push_back(path + " has every camera disabled");
+    }
+}
+
+static void checkDetector(const nlohmann::json& detectorConfig, const string& path, vector<string>& errors) {
+    checkFields(detectorConfig, path, detectorFields, errors);
+
+    checkRange(detectorConfig, path, "tagSizeMeters", 1e-3, numeric_limits<double>::infinity(), errors);
+    checkAtLeast(detectorConfig, path, "maxTagsPerFrame", 1, errors);
+    checkAtLeast(detectorConfig, path, "decimation", 1, errors);
+    checkAtLeast(detectorConfig, path, "adaptiveThreshWinMin", 3, errors);
+    checkAtLeast(detectorConfig, path, "adaptiveThreshWinStep", 1, errors);
+    checkOneOf(detectorConfig, path, "thresholdBackend", {"opencv", "simd"}, errors);
+    checkAtLeast(detectorConfig, path, "detectionTiles", 1, errors);
+    checkRange(detectorConfig, path, "detectionTileOverlap", 0, 1, errors);
+    checkRange(detectorConfig, path, "errorCorrectionRate", 0, 1, errors);
+    checkAtLeast(detectorConfig, path, "trackingFullSearchInterval", 1, errors);
+    checkAtLeast(detectorConfig, path, "trackingTimeoutMilliseconds", 0, errors);
+
+    if (isInteger(detectorConfig, "adaptiveThreshWinMax") && isInteger(detectorConfig, "adaptiveThreshWinMin") &&
+        detectorConfig["adaptiveThreshWinMax"] < detectorConfig["adaptiveThreshWinMin"]) {
+        errors.push_back(path + ".adaptiveThreshWinMax is below adaptiveThreshWinMin");
+    }
+}
+
+static void checkThreading(const nlohmann::json& threadConfig, const string& path, int cameraCount,
+    vector<string>& errors) {
+    checkFields(threadConfig, path, threadingFields, errors);
+
+    checkAtLeast(threadConfig, path, "totalThreads", 1, errors);
+    checkAtLeast(threadConfig, path, "defaultThreadsPerCamera", 1, errors);
+    checkAtLeast(threadConfig, path, "minThreadsPerCamera", 1, errors);
+    checkAtLeast(threadConfig, path, "minThreadOffsetMilliseconds", 0, errors);
+    checkAtLeast(threadConfig, path, "allocationIntervalMilliseconds", 1, errors);
+    checkRange(threadConfig, path, "allocationSmoothing", 1e-3, 1, errors);
+    checkAtLeast(threadConfig, path, "allocationExplorationWeight", 0, errors);
+    checkAtLeast(threadConfig, path, "allocationFrameRateHeadroom", 1, errors);
+
+    if (isInteger(threadConfig, "minThreadsPerCamera") && isInteger(threadConfig, "totalThreads") &&
+        threadConfig["minThreadsPerCamera"].get<int>() * cameraCount > threadConfig["totalThreads"].get<int>()) {
+        errors.push_back(path + ": minThreadsPerCamera for " + to_string(cameraCount) +
+            " cameras is more than totalThreads");
+    }
+
+    if (!threadConfig.contains("placement") || !threadConfig["placement"].is_object()) {
+        return;
+    }
+
+    const nlohmann::json& placementConfig = threadConfig["placement"];
+    checkFields(placementConfig, path + ".placement", placementFields, errors);
+
+    for (const Field& role : placementFields) {
+        if (!placementConfig.contains(role.key) || !placementConfig[role.key].is_object()) {
+            continue;
+        }
+
+        string where = path + ".placement." + role.key;
+        const nlohmann::json& placement = placementConfig[role.key];
+
+        checkFields(placement, where, threadPlacementFields, errors);
+        checkOneOf(placement, where, "policy", {"fifo", "other"}, errors);
+        checkRange(placement, where, "priority", 1, 99, errors);
+        checkRange(placement, where, "nice", -20, 19, errors);
+
+        if (placement.contains("cores")) {
+            const nlohmann::json& cores = placement["cores"];
+            if (cores.is_string()) {
+                checkOneOf(placement, where, "cores", {"big", "little", "all"}, errors);
+            } else if (!cores.is_array() || !all_of(cores.begin(), cores.end(),
+                [](const nlohmann::json& core) { return core.is_number_integer() && core >= 0; })) {
+                errors.push_back(where + ".cores should be a core class or a list of CPU numbers");
+            }
+        }
+    }
+}
+
+static void checkFieldLayout(const nlohmann::json& layoutConfig, const string& path, vector<string>& errors) {
+    checkFields(layoutConfig, path, fieldLayoutFields, errors);
+
+    if (layoutConfig.contains("field") && layoutConfig["field"].is_object()) {
+        checkFields(layoutConfig["field"], path + ".field", fieldSizeFields, errors);
+    }
+
+    if (!layoutConfig.contains("tags")) {
+        return;
+    }
+    if (!layoutConfig["tags"].is_array()) {
+        errors.push_back(path + ".tags should be a list of tags");
+        return;
+    }
+
+    // Which tag gave each id, to catch two placing the same one.
+    map<int, int> ids;
+
+    for (int i = 0; i < layoutConfig["tags"].size(); i++) {
+        string where = path + " tags[" + to_string(i) + "]";
+        const nlohmann::json& tag = layoutConfig["tags"][i];
+
+        if (!tag.is_object()) {
+            errors.push_back(where + " isn't a tag");
+            continue;
+        }
+
+        checkFields(tag, where, fieldTagFields, errors);
+        checkAtLeast(tag, where, "ID", 0, errors);
+
+        if (tag.contains("ID") && tag["ID"].is_number_integer()) {
+            int id = tag["ID"];
+            if (ids.count(id) > 0) {
+                errors.push_back(where + " places tag " + to_string(id) + ", already placed by tags[" +
+                    to_string(ids[id]) + "]");
+            } else {
+                ids[id] = i;
+            }
+        }
+
+        if (!tag.contains("pose") || !tag["pose"].is_object()) {
+            continue;
+        }
+
+        const nlohmann::json& pose = tag["pose"];
+        checkFields(pose, where + ".pose", tagPoseFields, errors);
+
+        if (pose.contains("translation") && pose["translation"].is_object()) {
+            checkFields(pose["translation"], where + ".pose.translation", translationFields, errors);
+        }
+
+        if (!pose.contains("rotation") || !pose["rotation"].is_object()) {
+            continue;
+        }
+
+        const nlohmann::json& rotation = pose["rotation"];
+        checkFields(rotation, where + ".pose.rotation", rotationFields, errors);
+
+        if (!rotation.contains("quaternion") || !rotation["quaternion"].is_object()) {
+            continue;
+        }
+
+        const nlohmann::json& quaternion = rotation["quaternion"];
+        string quaternionWhere = where + ".pose.rotation.quaternion";
+        checkFields(quaternion, quaternionWhere, quaternionFields, errors);
+
+        // FieldLayout turns the quaternion into a rotation matrix as is, so it has to be a unit one.
+        double squaredNorm = 0;
+        for (const Field& component : quaternionFields) {
+            if (quaternion.contains(component.key) && quaternion[component.key].is_number()) {
+                double value = quaternion[component.key];
+                squaredNorm += value * value;
+            }
+        }
+        if (abs(sqrt(squaredNorm) - 1) > 1e-3) {
+            errors.push_back(quaternionWhere + " has length " + number(sqrt(squaredNorm)) + ", not 1");
+        }
+    }
+}
+
+static void checkTrace(const nlohmann::json& traceConfig, const string& path, vector<string>& errors) {
+    checkFields(traceConfig, path, traceFields, errors);
+    checkRange(traceConfig, path, "eventsPerThread", 1, 1 << 24, errors);
+
+    bool enabled = traceConfig.contains("enabled") && traceConfig["enabled"].is_boolean() && traceConfig["enabled"];
+    if (enabled && traceConfig.contains("path") && traceConfig["path"].is_string() && traceConfig["path"] == "") {
+        errors.push_back(path + ".path is empty, so there's nowhere to dump the trace");
+    }
+}
+
+static void checkResolutions(const nlohmann::json& benchConfig, const string& path, vector<string>& errors) {
+    if (!benchConfig.contains("resolutions")) {
+        return;
+    }
+
+    const nlohmann::json& resolutions = benchConfig["resolutions"];
+    bool valid = resolutions.is_array() && !resolutions.empty();
+    for (const nlohmann::json& resolution : resolutions) {
+        valid = valid && resolution.is_array() && resolution.size() == 2 && all_of(resolution.begin(),
+            resolution.end(), [](const nlohmann::json& side) { return side.is_number_integer() && side >= 1; });
+    }
+
+    if (!valid) {
+        errors.push_back(path + ".resolutions should be a list of [width, height] pairs");
+    }
+}
+
+static void checkBench(const nlohmann::json& benchConfig, const string& path, int cameraCount,
+    vector<string>& errors) {
+    checkFields(benchConfig, path, benchFields, errors);
+
+    checkRange(benchConfig, path, "camera", 0, cameraCount - 1, errors);
+    checkAtLeast(benchConfig, path, "preloadFrames", 1, errors);
+    checkAtLeast(benchConfig, path, "frames", 1, errors);
+    int frames = benchConfig.contains("frames") && benchConfig["frames"].is_number_integer() ?
+        benchConfig["frames"].get<int>() : numeric_limits<int>::max();
+    checkRange(benchConfig, path, "warmupFrames", 0, frames - 1.0, errors);
+
+    if (benchConfig.contains("threads")) {
+        const nlohmann::json& threads = benchConfig["threads"];
+        if (!threads.is_array() || threads.empty() || !all_of(threads.begin(), threads.end(),
+            [](const nlohmann::json& count) { return count.is_number_integer() && count >= 1; })) {
+            errors.push_back(path + ".threads should be a list of thread counts");
+        }
+    }
+
+    checkResolutions(benchConfig, path, errors);
+
+    if (benchConfig.contains("source") && benchConfig["source"].is_object()) {
+        const nlohmann::json& source = benchConfig["source"];
+        checkFields(source, path + ".source", benchSourceFields, errors);
+        checkOneOf(source, path + ".source", "type", sourceTypes, errors);
+        checkRange(source, path + ".source", "fps", 1e-3, numeric_limits<double>::infinity(), errors);
+
+        if (source.contains("scene") && source["scene"].is_object()) {
+            checkFields(source["scene"], path + ".source.scene", sceneFields, errors);
+        }
+    }
+}
+
+static void logErrors(const vector<string>& errors) {
+    for (const string& error : errors) {
+        // A site of its own for each, so the rate limit doesn't hide any of them.
+        LogSite site;
+        Log::write(site, LogLevel::Error, "Config: %s", error.c_str());
+    }
+}
+
+string configPath(const string& directory, const string& file) {
+    return (filesystem::path(directory) / file).string();
+}
+
+bool loadConfig(const string& directory, Config& config) {
+    config.directory = directory;
+
+    vector<string> errors;
+
+    string camerasPath = configPath(directory, "cameras.json");
+    string detectorPath = configPath(directory, "detector.json");
+    string threadingPath = configPath(directory, "threading.json");
+    string networkTablesPath = configPath(directory, "networkTables.json");
+    string tracePath = configPath(directory, "trace.json");
+    string layoutPath;
+
+    nlohmann::json camConfig;
+    nlohmann::json detectorConfig;
+    nlohmann::json layoutConfig;
+    nlohmann::json threadConfig;
+    nlohmann::json ntConfig;
+    nlohmann::json traceConfig;
+
+    if (readFile(camerasPath, camConfig, errors)) {
+        checkCameras(camConfig, camerasPath, errors);
+    }
+    if (readFile(detectorPath, detectorConfig, errors)) {
+        checkDetector(detectorConfig, detectorPath, errors);
+
+        // Relative layout paths are relative to the config directory.
+        if (detectorConfig.contains("fieldLayout") && detectorConfig["fieldLayout"].is_string()) {
+            string layoutFile = detectorConfig["fieldLayout"];
+            layoutPath = layoutFile.empty() ? layoutFile : configPath(directory, layoutFile);
+        }
+    }
+    if (!layoutPath.empty() && readFile(layoutPath, layoutConfig, errors)) {
+        checkFieldLayout(layoutConfig, layoutPath, errors);
+    }
+    if (readFile(threadingPath, threadConfig, errors)) {
+        // cameras.json may be missing or malformed; checkCameras has reported that.
+        int cameraCount = 0;
+        if (camConfig.is_object() && camConfig.contains("Cameras") && camConfig["Cameras"].is_object()) {
+            for (auto& camera : camConfig["Cameras"]) {
+                cameraCount += camera.is_object() && isEnabled(camera) ? 1 : 0;
+            }
+        }
+        checkThreading(threadConfig, threadingPath, cameraCount, errors);
+    }
+    if (readFile(networkTablesPath, ntConfig, errors)) {
+        checkFields(ntConfig, networkTablesPath, networkTablesFields, errors);
+        checkRange(ntConfig, networkTablesPath, "teamNumber", 0, 99999, errors);
+    }
+    if (readFile(tracePath, traceConfig, errors)) {
+        checkTrace(traceConfig, tracePath, errors);
+    }
+
+    if (!errors.empty()) {
+        logErrors(errors);
+        return false;
+    }
+
+    for (auto& item : camConfig["Cameras"].items()) {
+        if (isEnabled(item.value())) {
+            config.cameras.push_back(setupCameraConfig(item.value()));
+        }
+    }
+
+    DetectorConfig& detector = config.detector;
+    detector.tagSizeMeters = detectorConfig["tagSizeMeters"];
+    detector.maxTagsPerFrame = detectorConfig["maxTagsPerFrame"];
+    detector.decimation = detectorConfig["decimation"];
+
+    if (!layoutPath.empty()) {
+        detector.fieldTags = setupFieldTags(layoutConfig);
+    }
+
+    detector.detectParams = setupDetectorParameters(detectorConfig);
+    detector.tracking = setupTrackingParameters(detectorConfig);
+    detector.threshold = setupThresholdParameters(detectorConfig);
+
+    ThreadingConfig& threading = config.threading;
+    threading.totalThreads = threadConfig["totalThreads"];
+    threading.defaultThreadsPerCamera = threadConfig["defaultThreadsPerCamera"];
+    threading.minThreadOffsetMicros = threadConfig["minThreadOffsetMilliseconds"].get<int64_t>() * 1000;
+    threading.allocation = setupAllocationParameters(threadConfig);
+    threading.placements = setupThreadPlacements(threadConfig);
+
+    config.networkTables.teamNumber = ntConfig["teamNumber"];
+
+    config.trace.enabled = traceConfig["enabled"];
+    config.trace.eventsPerThread = traceConfig["eventsPerThread"];
+    config.trace.path = traceConfig["path"];
+
+    return true;
+}
+
+bool loadBenchConfig(const string& path, const Config& config, BenchConfig& bench) {
+    vector<string> errors;
+
+    nlohmann::json benchConfig;
+    if (readFile(path, benchConfig, errors)) {
+        checkBench(benchConfig, path, static_cast<int>(config.cameras.size()), errors);
+    }
+
+    if (!errors.empty()) {
+        logErrors(errors);
+        return false;
+    }
+
+    bench.camera = benchConfig["camera"];
+    bench.frames = benchConfig["frames"];
+    bench.warmupFrames = benchConfig["warmupFrames"];
+    bench.preloadFrames = benchConfig["preloadFrames"];
+    bench.threads = benchConfig["threads"].get<vector<int>>();
+
+    for (const nlohmann::json& resolution : benchConfig["resolutions"]) {
+        bench.resolutions.emplace_back(resolution[0].get<int>(), resolution[1].get<int>());
+    }
+
+    const CameraConfig& camera = config.cameras[bench.camera];
+    bench.source = setupBenchSource(benchConfig, camera.source, camera.matrix, camera.distCoeffs);
+
+    return true;
+}
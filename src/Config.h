@@ -0,0 +1,113 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/matx.hpp>
+#include <opencv2/core/types.hpp>
+#include <opencv2/objdetect/aruco_detector.hpp>
+
+#include "AllocationController.h"
+#include "FrameSource.h"
+#include "TagTracker.h"
+#include "ThreadPlacement.h"
+#include "ThresholdDetector.h"
+
+// Where config files are read from when no directory is given on the command line.
+inline constexpr const char* defaultConfigDir = "/root/Fisheye/config";
+
+struct CameraConfig {
+    std::vector<std::vector<double>> matrix;
+    std::vector<double> distCoeffs;
+    SourceConfig source;
+};
+
+// A tag of the field layout file: its center in field meters and its (W, X, Y, Z) orientation quaternion.
+struct FieldTag {
+    int id;
+    cv::Vec3d translation;
+    cv::Vec4d rotation;
+};
+
+struct DetectorConfig {
+    double tagSizeMeters;
+    int maxTagsPerFrame;
+    int decimation;
+    // From the layout file detector.json names, resolved against the config directory; empty when there's none.
+    std::vector<FieldTag> fieldTags;
+
+    cv::aruco::DetectorParameters detectParams;
+    TrackingParameters tracking;
+    ThresholdParameters threshold;
+
+    DetectorConfig();
+};
+
+struct ThreadingConfig {
+    int totalThreads;
+    int defaultThreadsPerCamera;
+    int64_t minThreadOffsetMicros;
+
+    AllocationParameters allocation;
+    ThreadPlacements placements;
+
+    ThreadingConfig();
+};
+
+struct NetworkTablesConfig {
+    int teamNumber;
+
+    NetworkTablesConfig();
+};
+
+struct TraceConfig {
+    bool enabled;
+    int eventsPerThread;
+    std::string path;
+
+    TraceConfig();
+};
+
+// cameras.json, detector.json and the field layout it names, threading.json, networkTables.json and trace.json, parsed
+// once into plain values so nothing after startup looks a setting up by name.
+struct Config {
+    std::string directory;
+
+    std::vector<CameraConfig> cameras;
+    DetectorConfig detector;
+    ThreadingConfig threading;
+    NetworkTablesConfig networkTables;
+    TraceConfig trace;
+};
+
+// bench.json, shared by fisheye_bench and fisheye_threshold_bench.
+struct BenchConfig {
+    // Index into Config::cameras.
+    int camera;
+    int frames;
+    int warmupFrames;
+    int preloadFrames;
+    std::vector<int> threads;
+    std::vector<cv::Size> resolutions;
+
+    // The camera's source, or bench.json's "source" when it has one, always read as fast as possible.
+    SourceConfig source;
+
+    BenchConfig();
+};
+
+// Reads and checks every file against what the pipeline expects: missing and unknown keys, wrong types, values out of
+// range, settings misplaced outside their camera and cameras sharing a device. Every problem is logged, not just the
+// first, and false returned when there were any, with config left incomplete. Starts no threads, so it can run before
+// tracing is set up.
+bool loadConfig(const std::string& directory, Config& config);
+
+// Reads and checks bench.json the same way, against a config loadConfig has already read.
+bool loadBenchConfig(const std::string& path, const Config& config, BenchConfig& bench);
+
+// A file of the config directory, like bench.json.
+std::string configPath(const std::string& directory, const std::string& file);
+
+#endif //CONFIG_H
@@ -0,0 +1,104 @@
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+
+#include "../include/json.hpp"
+
+#include "Config.h"
+#include "Log.h"
+
+using namespace std;
+
+// Checks that loadConfig turns broken config files into logged errors rather than exceptions. Each case copies the
+// shipped config directory, breaks one file and loads the copy.
+//
+// usage: fisheye_config_test <config directory>
+
+// Loads a copy of the shipped config broken by breakConfig, and says whether loadConfig's result was the expected one.
+bool runCase(const string& name, const filesystem::path& shipped, bool valid,
+    function<void(const filesystem::path&)> breakConfig) {
+    filesystem::path directory = filesystem::temp_directory_path() / ("fisheye_config_test_" + name);
+    filesystem::remove_all(directory);
+    filesystem::copy(shipped, directory);
+
+    breakConfig(directory);
+
+    bool loaded;
+    try {
+        Config config;
+        loaded = loadConfig(directory.string(), config);
+    } catch (const exception& error) {
+        cout << "FAILED: " << name << " threw " << error.what() << endl;
+        filesystem::remove_all(directory);
+        return false;
+    }
+
+    filesystem::remove_all(directory);
+
+    if (loaded != valid) {
+        cout << "FAILED: " << name << (valid ? " was rejected" : " was accepted") << endl;
+        return false;
+    }
+
+    return true;
+}
+
+void editFile(const filesystem::path& path, function<void(nlohmann::json&)> edit) {
+    ifstream in(path);
+    nlohmann::json contents = nlohmann::json::parse(in);
+    in.close();
+
+    edit(contents);
+
+    ofstream out(path);
+    out << contents.dump(4) << endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        cout << "usage: fisheye_config_test <config directory>" << endl;
+        return 1;
+    }
+
+    filesystem::path shipped = argv[1];
+
+    Log::start();
+
+    bool passed = true;
+
+    passed = runCase("shipped", shipped, true, [](const filesystem::path&) {}) && passed;
+
+    passed = runCase("missing_cameras", shipped, false, [](const filesystem::path& directory) {
+        filesystem::remove(directory / "cameras.json");
+    }) && passed;
+
+    passed = runCase("cameras_not_an_object", shipped, false, [](const filesystem::path& directory) {
+        ofstream(directory / "cameras.json") << "[]" << endl;
+    }) && passed;
+
+    passed = runCase("replay_backend", shipped, false, [](const filesystem::path& directory) {
+        editFile(directory / "cameras.json", [](nlohmann::json& cameras) {
+            cameras["Cameras"].begin().value()["backend"] = "synthetic";
+        });
+    }) && passed;
+
+    passed = runCase("threading_wrong_types", shipped, false, [](const filesystem::path& directory) {
+        editFile(directory / "threading.json", [](nlohmann::json& threading) {
+            threading["totalThreads"] = "4";
+            threading["minThreadsPerCamera"] = "1";
+        });
+    }) && passed;
+
+    passed = runCase("detector_wrong_types", shipped, false, [](const filesystem::path& directory) {
+        editFile(directory / "detector.json", [](nlohmann::json& detector) {
+            detector["adaptiveThreshWinMax"] = "23";
+        });
+    }) && passed;
+
+    Log::flush();
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,39 @@
+#include "DetectorPool.h"
+
+using namespace std;
+using namespace cv;
+
+PooledDetector::PooledDetector(const aruco::Dictionary& dictionary, const aruco::DetectorParameters& detectParams,
+    const ThresholdParameters& thresholdParams, int maxTags):
+detector(dictionary, detectParams), thresholdDetector(dictionary, detectParams, thresholdParams), scratch(maxTags) {}
+
+DetectorPool::DetectorPool(const aruco::Dictionary& dictionary, const aruco::DetectorParameters& detectParams,
+    const ThresholdParameters& thresholdParams, int size, int maxTags) {
+    detectors.reserve(size);
+    available.reserve(size);
+
+    for (int i = 0; i < size; i++) {
+        detectors.emplace_back(dictionary, detectParams, thresholdParams, maxTags);
+    }
+    for (PooledDetector& detector : detectors) {
+        available.push_back(&detector);
+    }
+}
+
+PooledDetector* DetectorPool::checkOut() {
+    unique_lock<mutex> lock(poolMutex);
+    poolCondition.wait(lock, [this] { return !available.empty(); });
+
+    PooledDetector* detector = available.back();
+    available.pop_back();
+
+    return detector;
+}
+
+void DetectorPool::checkIn(PooledDetector* detector) {
+    unique_lock<mutex> lock(poolMutex);
+    available.push_back(detector);
+    lock.unlock();
+
+    poolCondition.notify_one();
+}
@@ -0,0 +1,40 @@
+#ifndef DETECTORPOOL_H
+#define DETECTORPOOL_H
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/objdetect/aruco_detector.hpp>
+#include <opencv2/objdetect/aruco_dictionary.hpp>
+
+#include "ThresholdDetector.h"
+#include "Utils.h"
+
+struct PooledDetector {
+    cv::aruco::ArucoDetector detector;
+    ThresholdDetector thresholdDetector;
+    FrameScratch scratch;
+
+    PooledDetector(const cv::aruco::Dictionary& dictionary, const cv::aruco::DetectorParameters& detectParams,
+        const ThresholdParameters& thresholdParams, int maxTags);
+};
+
+// Long-lived detectors and scratch buffers for one camera. A worker checks one out for the length of an iteration and
+// checks it back in, so both are built once at startup rather than per task.
+class DetectorPool {
+    public:
+        DetectorPool(const cv::aruco::Dictionary& dictionary, const cv::aruco::DetectorParameters& detectParams,
+            const ThresholdParameters& thresholdParams, int size, int maxTags);
+
+        PooledDetector* checkOut();
+        void checkIn(PooledDetector* detector);
+    private:
+        std::vector<PooledDetector> detectors;
+        std::vector<PooledDetector*> available;
+
+        std::mutex poolMutex;
+        std::condition_variable poolCondition;
+};
+
+#endif //DETECTORPOOL_H
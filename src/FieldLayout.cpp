@@ -0,0 +1,39 @@
+#include "FieldLayout.h"
+
+using namespace std;
+using namespace cv;
+
+FieldLayout::FieldLayout(double tagSize) {
+    this->halfLength = tagSize / 2;
+}
+
+void FieldLayout::addTag(int id, const Vec3d& translation, const Vec4d& rotation) {
+    double w = rotation(0), x = rotation(1), y = rotation(2), z = rotation(3);
+
+    Matx33d tagToField(1 - 2 * (y * y + z * z), 2 * (x * y - z * w), 2 * (x * z + y * w),
+        2 * (x * y + z * w), 1 - 2 * (x * x + z * z), 2 * (y * z - x * w),
+        2 * (x * z - y * w), 2 * (y * z + x * w), 1 - 2 * (x * x + y * y));
+
+    // WPILib tag frames have X out of the tag face, so facing the tag +Y is to the right and +Z is up.
+    array<Vec3d, 4> tagCorners = {
+        Vec3d(0, -halfLength, halfLength),
+        Vec3d(0, halfLength, halfLength),
+        Vec3d(0, halfLength, -halfLength),
+        Vec3d(0, -halfLength, -halfLength)
+    };
+
+    array<Point3d, 4>& fieldCorners = corners[id];
+    for (int i = 0; i < 4; i++) {
+        Vec3d corner = tagToField * tagCorners[i] + translation;
+        fieldCorners[i] = Point3d(corner(0), corner(1), corner(2));
+    }
+}
+
+bool FieldLayout::empty() const {
+    return corners.empty();
+}
+
+const array<Point3d, 4>* FieldLayout::tagCorners(int id) const {
+    auto tag = corners.find(id);
+    return tag == corners.end() ? nullptr : &tag->second;
+}
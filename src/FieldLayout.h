@@ -0,0 +1,29 @@
+#ifndef FIELDLAYOUT_H
+#define FIELDLAYOUT_H
+
+#include <array>
+#include <unordered_map>
+
+#include <opencv2/core/matx.hpp>
+#include <opencv2/core/types.hpp>
+
+// Field-frame positions of every tag's corners, built from a WPILib AprilTagFieldLayout file.
+class FieldLayout {
+    public:
+        FieldLayout(double tagSize);
+
+        // translation is the tag center in field meters, rotation the tag's (W, X, Y, Z) orientation quaternion.
+        void addTag(int id, const cv::Vec3d& translation, const cv::Vec4d& rotation);
+
+        bool empty() const;
+
+        // Corners in the same order the detector reports them: top-left, top-right, bottom-right, bottom-left as seen
+        // when facing the tag.
+        const std::array<cv::Point3d, 4>* tagCorners(int id) const;
+    private:
+        double halfLength;
+
+        std::unordered_map<int, std::array<cv::Point3d, 4>> corners;
+};
+
+#endif //FIELDLAYOUT_H
@@ -1,93 +1,27 @@
 #include <algorithm>
-#include <fstream>
 #include <functional>
-#include <future>
 
 #include <opencv2/core/hal/interface.h>
 #include <opencv2/core/matx.hpp>
 #include <opencv2/objdetect/aruco_detector.hpp>
 #include <opencv2/objdetect/aruco_dictionary.hpp>
 
-#include "../include/json.hpp"
-
 #include "../include/BS_thread_pool.hpp"
 
+#include "AllocationController.h"
 #include "Camera.h"
+#include "CompletionQueue.h"
+#include "Config.h"
+#include "FieldLayout.h"
+#include "FrameRecord.h"
+#include "Log.h"
+#include "Setup.h"
 
 using namespace cv;
 using namespace std;
 using namespace nt;
 
-void setupCameraValues(vector<vector<vector<double>>> &cameraMatricies, vector<vector<double>> &cameraDistCoeffs, vector<String> &camIDs,
-    vector<vector<int>> &resolutions, vector<int> &cameraFPSs) {
-    ifstream camJSON("/root/Fisheye/config/cameras.json");
-    nlohmann::json camConfig = nlohmann::json::parse(camJSON);
-    for (auto camera : camConfig["Cameras"]) {
-        camIDs.push_back(camera["id"]);
-
-        vector<vector<double>> cameraMatrix(3, vector<double>(3, 0));
-
-        cameraMatrix[0][0] = camera["matrix"]["fx"];
-        cameraMatrix[0][2] = camera["matrix"]["cx"];
-        cameraMatrix[1][1] = camera["matrix"]["fy"];
-        cameraMatrix[1][2] = camera["matrix"]["cy"];
-        cameraMatrix[2][2] = 1;
-
-        cameraMatricies.push_back(cameraMatrix);
-
-        vector<double> distCoeffs(5);
-        distCoeffs[0] = camera["distCoeffs"]["k1"];
-        distCoeffs[1] = camera["distCoeffs"]["k2"];
-        distCoeffs[2] = camera["distCoeffs"]["p1"];
-        distCoeffs[3] = camera["distCoeffs"]["p2"];
-        distCoeffs[4] = camera["distCoeffs"]["k3"];
-
-        cameraDistCoeffs.push_back(distCoeffs);
-
-        vector<int> resolution(2);
-        resolution[0] = camera["frameWidth"];
-        resolution[1] = camera["frameHeight"];
-        resolutions.push_back(resolution);
-
-        cameraFPSs.push_back(camera["fps"]);
-    }
-}
-
-aruco::DetectorParameters setupDetectorParameters(nlohmann::json detectorConfig) {
-    aruco::DetectorParameters detectParams = aruco::DetectorParameters();
-
-    detectParams.adaptiveThreshWinSizeMin = detectorConfig["adaptiveThreshWinMin"];
-    detectParams.adaptiveThreshWinSizeMax = detectorConfig["adaptiveThreshWinMax"];
-    detectParams.adaptiveThreshWinSizeStep = detectorConfig["adaptiveThreshWinStep"];
-
-    detectParams.minMarkerPerimeterRate = detectorConfig["minMarkerPerimiterRate"];
-    detectParams.maxMarkerPerimeterRate = detectorConfig["maxMarkerPerimiterRate"];
-
-    detectParams.minMarkerDistanceRate = detectorConfig["minMarkerDistanceRate"];
-
-    detectParams.minDistanceToBorder = detectorConfig["minDistanceToBorder"];
-
-    detectParams.perspectiveRemovePixelPerCell = detectorConfig["perspectiveRemovePixelPerCell"];
-    detectParams.perspectiveRemoveIgnoredMarginPerCell = detectorConfig["perspectiveRemoveIgnoredMarginPerCell"];
-
-    detectParams.maxErroneousBitsInBorderRate = detectorConfig["maxErroneousBitsInBorderRate"];
-    detectParams.errorCorrectionRate = detectorConfig["errorCorrectionRate"];
-
-    detectParams.cornerRefinementMethod = aruco::CORNER_REFINE_APRILTAG;
-    detectParams.relativeCornerRefinmentWinSize = detectorConfig["relativeCornerRefinmentWinSize"];
-    detectParams.cornerRefinementMaxIterations = detectorConfig["cornerRefinementMaxIterations"];
-    detectParams.cornerRefinementMinAccuracy = detectorConfig["cornerRefinementMinAccuracy"];
-
-    detectParams.useAruco3Detection = true;
-
-    return detectParams;
-}
-
-void setupNetworkTables(int numCameras, vector<DoubleArrayPublisher>& tvecPublishers,
-    vector<DoubleArrayPublisher>& rmatPublishers, vector<IntegerPublisher>& idPublishers) {
-    ifstream ntJSON("/root/Fisheye/config/networkTables.json");
-    nlohmann::json ntConfig = nlohmann::json::parse(ntJSON);
-
+void setupNetworkTables(const NetworkTablesConfig& ntConfig, int numCameras, vector<RawPublisher>& framePublishers) {
     auto ntInst = NetworkTableInstance::GetDefault();
     auto ntTable = ntInst.GetTable("fisheye");
 
@@ -96,24 +30,14 @@ void setupNetworkTables(int numCameras, vector<DoubleArrayPublisher>& tvecPublis
     options->keepDuplicates = true;
 
     for (int i = 0; i < numCameras; i++) {
-        DoubleArrayTopic tvecTopic = ntTable->GetDoubleArrayTopic("/camera" + to_string(i) + "/tvec");
-        tvecTopic.SetPersistent(false);
-        tvecTopic.SetCached(false);
-        tvecPublishers.push_back(tvecTopic.Publish(*options));
-
-        DoubleArrayTopic rmatTopic = ntTable->GetDoubleArrayTopic("/camera" + to_string(i) + "/rmat");
-        rmatTopic.SetPersistent(false);
-        rmatTopic.SetCached(false);
-        rmatPublishers.push_back(rmatTopic.Publish(*options));
-
-        IntegerTopic idTopic = ntTable->GetIntegerTopic("/camera" + to_string(i) + "/id");
-        idTopic.SetPersistent(false);
-        idTopic.SetCached(false);
-        idPublishers.push_back(idTopic.Publish(*options));
+        RawTopic frameTopic = ntTable->GetRawTopic("/camera" + to_string(i) + "/frame");
+        frameTopic.SetPersistent(false);
+        frameTopic.SetCached(false);
+        framePublishers.push_back(frameTopic.Publish(frameRecordType, *options));
     }
 
     ntInst.StartClient4("fisheye");
-    ntInst.SetServerTeam(ntConfig["teamNumber"]);
+    ntInst.SetServerTeam(ntConfig.teamNumber);
 
     ntInst.AddConnectionListener(true, [] (const nt::Event& event) {
       if (event.Is(nt::EventFlags::kDisconnected)) {
@@ -123,93 +47,132 @@ void setupNetworkTables(int numCameras, vector<DoubleArrayPublisher>& tvecPublis
     });
 }
 
-void caclulatePriority(nlohmann::json threadConfig, vector<Camera>& cameras, vector<int> camsWithPriority) {
-    int priorityThreads = threadConfig["totalThreads"].get<int>() - (cameras.size() - camsWithPriority.size()) *
-        threadConfig["minThreadsPerCamera"].get<int>();
+static const int64_t frameReportIntervalMicros = 5000000;
+
+// One line for every camera, as the log lets each statement through only once a second.
+void logFrameCounts(const vector<Camera>& cameras) {
+    string report;
     for (int i = 0; i < cameras.size(); i++) {
-        cameras[i].threadset.totalThreads = (count(camsWithPriority.begin(), camsWithPriority.end(), i) > 0) ?
-            priorityThreads / camsWithPriority.size() : (camsWithPriority.size() == 0) ?
-                threadConfig["defaultThreadsPerCamera"].get<int>() : threadConfig["minThreadsPerCamera"].get<int>();
+        FrameCounts counts = cameras[i].frameCounts();
+        report += (i == 0 ? "" : ", ") + to_string(i) + ": " + to_string(counts.captured) + "/" +
+            to_string(counts.superseded) + "/" + to_string(counts.stale) + "/" + to_string(counts.sourceDropped);
     }
+
+    LOG_INFO("Frames captured/superseded/stale/dropped by source, per camera: %s", report.c_str());
 }
 
-int main() {
-    vector<vector<vector<double>>> cameraMatricies;
-    vector<vector<double>> cameraDistCoeffs;
-    vector<String> cameraIDs;
-    vector<vector<int>> resolutions;
-    vector<int> cameraFPSs;
+// usage: fisheye [config directory]
+int main(int argc, char** argv) {
+    string configDir = argc > 1 ? argv[1] : defaultConfigDir;
 
-    setupCameraValues(cameraMatricies, cameraDistCoeffs, cameraIDs, resolutions, cameraFPSs);
+    Config config;
+    bool configValid = loadConfig(configDir, config);
 
-    ifstream detectorJSON("/root/Fisheye/config/detector.json");
-    nlohmann::json detectorConfig = nlohmann::json::parse(detectorJSON);
+    // Tracing stays off when the config couldn't be read, as config.trace is left at its defaults.
+    setupTrace(config.trace);
+    Trace::nameThread("dispatcher");
 
-    float tagSizeMeters = detectorConfig["tagSizeMeters"];
+    const ThreadingConfig& threading = config.threading;
+    const DetectorConfig& detector = config.detector;
+    const ThreadPlacements& placements = threading.placements;
 
-    Mat objPoints(4, 1, CV_32FC3);
-    objPoints.ptr<Vec3f>(0)[0] = Vec3f(-tagSizeMeters/2.f, tagSizeMeters/2.f, 0);
-    objPoints.ptr<Vec3f>(0)[1] = Vec3f(tagSizeMeters/2.f, tagSizeMeters/2.f, 0);
-    objPoints.ptr<Vec3f>(0)[2] = Vec3f(tagSizeMeters/2.f, -tagSizeMeters/2.f, 0);
-    objPoints.ptr<Vec3f>(0)[3] = Vec3f(-tagSizeMeters/2.f, -tagSizeMeters/2.f, 0);
+    // Threads inherit placement from the thread that starts them, so the log writer and NetworkTables' threads are
+    // started under the publisher's before this thread becomes the dispatcher.
+    placements.publisher.apply("publisher");
 
-    aruco::DetectorParameters detectParams = setupDetectorParameters(detectorConfig);
+    Log::start();
+
+    if (!configValid) {
+        Log::flush();
+        return 1;
+    }
 
     aruco::Dictionary dict = aruco::getPredefinedDictionary(aruco::DICT_APRILTAG_36h11);
 
-    vector<DoubleArrayPublisher> tvecPublishers;
-    vector<DoubleArrayPublisher> rmatPublishers;
-    vector<IntegerPublisher> idPublishers;
+    vector<RawPublisher> framePublishers;
+
+    setupNetworkTables(config.networkTables, config.cameras.size(), framePublishers);
 
-    setupNetworkTables(cameraIDs.size(), tvecPublishers, rmatPublishers, idPublishers);
+    placements.dispatcher.apply("dispatcher");
+
+    FieldLayout fieldLayout = setupFieldLayout(detector);
 
     vector<Camera> cameras;
 
-    ifstream threadJSON("/root/Fisheye/config/threading.json");
-    nlohmann::json threadConfig = nlohmann::json::parse(threadJSON);
+    for (int i = 0; i < config.cameras.size(); i++) {
+        const CameraConfig& camera = config.cameras[i];
+        cameras.emplace_back(i, createFrameSource(camera.source), camera.matrix, camera.distCoeffs,
+            std::move(framePublishers[i]), fieldLayout.empty() ? nullptr : &fieldLayout, detector.tagSizeMeters,
+            detector.detectParams, dict, threading.defaultThreadsPerCamera, threading.totalThreads,
+            detector.maxTagsPerFrame, detector.tracking, detector.decimation, detector.threshold);
+        cameras.back().setMaxFrameAge(camera.source.maxFrameAgeMicros);
+    }
 
-    for (int i = 0; i < cameraIDs.size(); i++) {
-        cameras.emplace_back(cameraIDs[i], cameraMatricies[i], cameraDistCoeffs[i], resolutions[i], cameraFPSs[i],
-            std::move(tvecPublishers[i]), std::move(rmatPublishers[i]),
-            std::move(idPublishers[i]), objPoints, detectParams, dict, threadConfig["defaultThreadsPerCamera"],
-            threadConfig["maxTagSightingsPerCamera"]);
+    for (Camera& camera : cameras) {
+        camera.startCapture(placements.capture);
     }
 
-    BS::thread_pool threadPool(threadConfig["totalThreads"]);
+    BS::thread_pool threadPool(threading.totalThreads, [&placements] {
+        int worker = static_cast<int>(BS::this_thread::get_index().value());
+        Trace::nameThread("worker " + to_string(worker));
+        placements.workers.apply("worker", worker);
+    });
+
+    for (Camera& camera : cameras) {
+        camera.setTilePool(&threadPool);
+    }
 
-    vector<int> camsWithPriority;
+    int64_t minThreadOffsetMicros = threading.minThreadOffsetMicros;
 
-    vector<vector<aruco::ArucoDetector>> detectors;
-    vector<vector<future<aruco::ArucoDetector>>> detectorFutures;
+    AllocationController allocator(threading.allocation, static_cast<int>(cameras.size()));
+
+    CompletionQueue completions;
+
+    int64_t nextFrameReport = nt::Now() + frameReportIntervalMicros;
 
     while (true) {
+        int64_t now = nt::Now();
+        if (now >= nextFrameReport) {
+            logFrameCounts(cameras);
+            nextFrameReport = now + frameReportIntervalMicros;
+        }
+
+        int64_t timeoutMicros = min(nextFrameReport - now, allocator.update(cameras, now));
+
         for (int a = 0; a < cameras.size(); a++) {
-            for (int b = 0; b < detectorFutures[a].size(); b++) {
-                if (detectorFutures[a][b].wait_for(chrono::seconds(0)) == std::future_status::ready) {
-                    detectors[a].push_back(detectorFutures[a][b].get());
-                }
+            CameraThreadset& threadset = *cameras[a].threadset;
+
+            // A camera at its budget is woken by a completion, not a timeout.
+            if (threadset.full()) {
+                continue;
             }
-            unique_lock<mutex> lock(*cameras[a].comMutex);
-            if (cameras[a].threadset.tagSightings >= threadConfig["minTagSightingsForPriority"] &&
-                ranges::count(camsWithPriority, a) == 0) {
-                camsWithPriority.push_back(a);
 
-                caclulatePriority(threadConfig, cameras, camsWithPriority);
-            } else if (cameras[a].threadset.tagSightings < threadConfig["minTagSightingsForPriority"] &&
-                ranges::count(camsWithPriority, a) > 0) {
-                camsWithPriority.erase(find(camsWithPriority.begin(), camsWithPriority.end(), a));
+            int64_t sinceLastActivate = now - threadset.lastThreadActivateTime.load(memory_order_relaxed);
+            if (sinceLastActivate < minThreadOffsetMicros) {
+                int64_t untilNextActivate = minThreadOffsetMicros - sinceLastActivate;
+                timeoutMicros = timeoutMicros < 0 ? untilNextActivate : min(timeoutMicros, untilNextActivate);
+                continue;
+            }
 
-                caclulatePriority(threadConfig, cameras, camsWithPriority);
+            // Only this thread admits, so this can't fail after the check above; it's what keeps the pool's queue
+            // from holding more than the budget.
+            if (!threadset.admit(now)) {
+                continue;
             }
-            if (cameras[a].threadset.activeThreads != cameras[a].threadset.totalThreads &&
-                (nt::Now() - cameras[a].threadset.lastThreadActivateTime) / 1000 >= threadConfig["minThreadOffsetMilliseconds"]) {
-                aruco::ArucoDetector detector = detectors[a].empty() ?
-                    aruco::ArucoDetector(dict, detectParams) : detectors[a][detectors.size() - 1];
 
-                detectorFutures[a].push_back(threadPool.submit_task([&cameras, a, detector]
-                    {return cameras[a].runIteration(detector);}));
+            TraceSpan dispatchSpan("dispatch", a);
+
+            if (!threadset.full()) {
+                timeoutMicros = timeoutMicros < 0 ? minThreadOffsetMicros : min(timeoutMicros, minThreadOffsetMicros);
             }
-            lock.unlock();
+
+            threadPool.detach_task([&cameras, &completions, a] {
+                cameras[a].runIteration();
+                cameras[a].threadset->release();
+                completions.push();
+            });
         }
+
+        completions.waitFor(timeoutMicros);
     }
 }
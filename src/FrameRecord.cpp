@@ -0,0 +1,59 @@
+#include "FrameRecord.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace cv;
+
+template <typename T>
+static void append(vector<uint8_t>& record, const T& value) {
+    size_t offset = record.size();
+    record.resize(offset + sizeof(T));
+    memcpy(record.data() + offset, &value, sizeof(T));
+}
+
+static void appendPose(vector<uint8_t>& record, const Pose& pose) {
+    for (double value : pose.tvec.val) {
+        append(record, value);
+    }
+    for (double value : pose.rmat.val) {
+        append(record, value);
+    }
+}
+
+void writeFrameRecord(const FrameScratch& scratch, uint64_t sequence, int64_t captureTimestamp, int64_t latency,
+    vector<uint8_t>& record) {
+    record.clear();
+
+    append(record, sequence);
+    append(record, captureTimestamp);
+    append(record, latency);
+
+    append(record, static_cast<int32_t>(scratch.fieldTagCount));
+    if (scratch.fieldTagCount > 0) {
+        append(record, scratch.fieldReprojectionError);
+        appendPose(record, scratch.fieldPose);
+    } else {
+        append(record, 0.0);
+        appendPose(record, Pose(Matx31d::zeros(), Matx33d::zeros()));
+    }
+
+    size_t tagCountOffset = record.size();
+    int32_t tagCount = 0;
+    append(record, tagCount);
+
+    for (int i = 0; i < scratch.tagCount; i++) {
+        if (!isfinite(scratch.reprojectionErrors[i])) {
+            continue;
+        }
+
+        append(record, static_cast<int32_t>(scratch.apriltags[i].id));
+        appendPose(record, scratch.poses[i]);
+        append(record, scratch.reprojectionErrors[i]);
+
+        tagCount += 1;
+    }
+
+    memcpy(record.data() + tagCountOffset, &tagCount, sizeof(tagCount));
+}
@@ -0,0 +1,26 @@
+#ifndef FRAMERECORD_H
+#define FRAMERECORD_H
+
+#include <cstdint>
+#include <vector>
+
+#include "Utils.h"
+
+// Type string of the raw NetworkTables topic carrying one record per processed frame.
+inline constexpr const char* frameRecordType = "fisheye.FrameRecord";
+
+// Serializes a frame's observations into record, replacing its contents. The layout is packed and little-endian:
+//   uint64 sequence, int64 captureTimestamp (us, NetworkTables clock), int64 latency (us, capture to publish),
+//   int32 fieldTagCount, double fieldReprojectionError, double fieldTvec[3], double fieldRmat[9] (row-major),
+//   int32 tagCount, then per tag: int32 id, double tvec[3], double rmat[9] (row-major), double reprojectionError
+// The field block is all zeros when fieldTagCount is 0. Tag and field poses are camera-in-tag and camera-in-field.
+// Tags whose pose couldn't be solved are left out.
+//
+// Every processed frame is published, including those where no tag was found or solved: their record has tagCount 0
+// and a zeroed field block. Consumers can tell an empty view from a stalled camera by sequence and captureTimestamp
+// still advancing, and no separate heartbeat is sent. Frames dropped before detection, as superseded or stale, get no
+// record, which shows as a gap in sequence.
+void writeFrameRecord(const FrameScratch& scratch, uint64_t sequence, int64_t captureTimestamp, int64_t latency,
+    std::vector<uint8_t>& record);
+
+#endif //FRAMERECORD_H
@@ -0,0 +1,155 @@
+#include "FrameSlot.h"
+
+#include <atomic>
+#include <thread>
+#include <utility>
+
+using namespace std;
+using namespace cv;
+
+Frame::Frame() {
+    this->sequence = 0;
+    this->timestamp = 0;
+}
+
+FrameLease::FrameLease() {
+    this->slot = nullptr;
+    this->index = -1;
+}
+
+FrameLease::FrameLease(FrameSlot* slot, int index) {
+    this->slot = slot;
+    this->index = index;
+}
+
+FrameLease::FrameLease(FrameLease&& other) noexcept {
+    slot = exchange(other.slot, nullptr);
+    index = exchange(other.index, -1);
+}
+
+FrameLease& FrameLease::operator=(FrameLease&& other) noexcept {
+    if (this != &other) {
+        release();
+        slot = exchange(other.slot, nullptr);
+        index = exchange(other.index, -1);
+    }
+    return *this;
+}
+
+FrameLease::~FrameLease() {
+    release();
+}
+
+const Frame& FrameLease::operator*() const {
+    return slot->buffers[index];
+}
+
+const Frame* FrameLease::operator->() const {
+    return &slot->buffers[index];
+}
+
+FrameLease::operator bool() const {
+    return slot != nullptr;
+}
+
+void FrameLease::release() {
+    if (slot != nullptr) {
+        slot->readers[index].fetch_sub(1);
+        slot = nullptr;
+        index = -1;
+    }
+}
+
+FrameSlot::FrameSlot(int maxReaders):
+buffers(maxReaders + 2), readers(new atomic<int>[maxReaders + 2]) {
+    for (int i = 0; i < buffers.size(); i++) {
+        readers[i].store(0);
+    }
+
+    latest.store(0);
+    claimed.store(0);
+    skipped.store(0);
+
+    writeIndex = 0;
+    nextSequence = 1;
+}
+
+Frame& FrameSlot::beginWrite() {
+    while (true) {
+        int current = static_cast<int>(latest.load() & indexMask);
+        for (int i = 0; i < buffers.size(); i++) {
+            // A reader can only pin a buffer it saw published as latest, and re-checks latest after pinning,
+            // so a buffer that is neither latest nor pinned here is safe to overwrite.
+            if (i != current && readers[i].load() == 0) {
+                writeIndex = i;
+                return buffers[i];
+            }
+        }
+        this_thread::yield();
+    }
+}
+
+void FrameSlot::commitWrite() {
+    uint64_t sequence = nextSequence++;
+    buffers[writeIndex].sequence = sequence;
+
+    latest.store((sequence << indexBits) | static_cast<uint64_t>(writeIndex));
+    latest.notify_all();
+}
+
+FrameLease FrameSlot::claimLatest() {
+    while (true) {
+        uint64_t packed = latest.load();
+        uint64_t sequence = packed >> indexBits;
+
+        if (sequence == 0 || sequence <= claimed.load()) {
+            return {};
+        }
+
+        int index = static_cast<int>(packed & indexMask);
+        readers[index].fetch_add(1);
+
+        if (latest.load() != packed) {
+            readers[index].fetch_sub(1);
+            continue;
+        }
+
+        uint64_t previous = claimed.load();
+        while (previous < sequence && !claimed.compare_exchange_weak(previous, sequence)) {}
+
+        if (previous >= sequence) {
+            readers[index].fetch_sub(1);
+            return {};
+        }
+        claimed.notify_all();
+
+        // Everything published between the previous claim and this one was never handed out.
+        skipped.fetch_add(sequence - previous - 1, memory_order_relaxed);
+
+        return {this, index};
+    }
+}
+
+void FrameSlot::waitForUnclaimed() const {
+    uint64_t packed = latest.load();
+    while ((packed >> indexBits) <= claimed.load()) {
+        latest.wait(packed);
+        packed = latest.load();
+    }
+}
+
+void FrameSlot::waitForClaimed() const {
+    uint64_t sequence = claimed.load();
+    while (sequence < (latest.load() >> indexBits)) {
+        claimed.wait(sequence);
+        sequence = claimed.load();
+    }
+}
+
+uint64_t FrameSlot::latestSequence() const {
+    return latest.load() >> indexBits;
+}
+
+uint64_t FrameSlot::skippedFrames() const {
+    return skipped.load(memory_order_relaxed);
+}
@@ -0,0 +1,76 @@
+#ifndef FRAMESLOT_H
+#define FRAMESLOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+
+struct Frame {
+    cv::Mat image;
+    uint64_t sequence;
+    int64_t timestamp;
+
+    Frame();
+};
+
+class FrameSlot;
+
+// Keeps a published frame's buffer from being reused by the capture thread until released.
+class FrameLease {
+    public:
+        FrameLease();
+        FrameLease(FrameSlot* slot, int index);
+        FrameLease(FrameLease&& other) noexcept;
+        FrameLease& operator=(FrameLease&& other) noexcept;
+        FrameLease(const FrameLease&) = delete;
+        FrameLease& operator=(const FrameLease&) = delete;
+        ~FrameLease();
+
+        const Frame& operator*() const;
+        const Frame* operator->() const;
+        explicit operator bool() const;
+
+        void release();
+    private:
+        FrameSlot* slot;
+        int index;
+};
+
+// Lock-free "latest frame" exchange between one capture thread and any number of detection workers.
+// With a single reader this is a plain triple buffer; every additional reader that may hold a lease adds one buffer
+// so the capture thread always has a free buffer to write into and never waits on a worker.
+class FrameSlot {
+    public:
+        explicit FrameSlot(int maxReaders);
+
+        Frame& beginWrite();
+        void commitWrite();
+
+        FrameLease claimLatest();
+        void waitForUnclaimed() const;
+        void waitForClaimed() const;
+
+        uint64_t latestSequence() const;
+        // Frames replaced by a newer one before any worker claimed them.
+        uint64_t skippedFrames() const;
+    private:
+        friend class FrameLease;
+
+        static constexpr uint64_t indexBits = 8;
+        static constexpr uint64_t indexMask = (1 << indexBits) - 1;
+
+        std::vector<Frame> buffers;
+        std::unique_ptr<std::atomic<int>[]> readers;
+
+        std::atomic<uint64_t> latest;
+        std::atomic<uint64_t> claimed;
+        std::atomic<uint64_t> skipped;
+
+        int writeIndex;
+        uint64_t nextSequence;
+};
+
+#endif //FRAMESLOT_H
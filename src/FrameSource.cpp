@@ -0,0 +1,419 @@
+#include "FrameSource.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <ctime>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <utility>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <ntcore/networktables/NetworkTableInstance.h>
+
+#include "Log.h"
+#include "V4l2Source.h"
+
+using namespace std;
+using namespace cv;
+
+SourceConfig::SourceConfig() {
+    this->type = "device";
+    this->width = 0;
+    this->height = 0;
+    this->pixelFormat = "YUYV";
+    this->fps = 0;
+    this->realtime = true;
+    this->loop = false;
+    this->color = false;
+    this->maxFrameAgeMicros = 0;
+}
+
+// Buffer timestamps further than this behind the read aren't from CLOCK_MONOTONIC, or the frame is too stale to trust.
+static constexpr int64_t maxBufferAgeMicros = 1000000;
+
+CaptureClock::CaptureClock() {
+    this->offset = 0;
+    this->nextSync = 0;
+}
+
+int64_t CaptureClock::monotonicNow() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+int64_t CaptureClock::toNtTime(int64_t monotonicMicros) {
+    int64_t now = monotonicNow();
+    if (now >= nextSync) {
+        sync();
+        nextSync = now + 1000000;
+    }
+
+    return monotonicMicros + offset;
+}
+
+void CaptureClock::sync() {
+    int64_t tightest = numeric_limits<int64_t>::max();
+
+    for (int a = 0; a < 5; a++) {
+        int64_t before = monotonicNow();
+        int64_t ntNow = nt::Now();
+        int64_t after = monotonicNow();
+
+        if (after - before < tightest) {
+            tightest = after - before;
+            offset = ntNow - (before + after) / 2;
+        }
+    }
+}
+
+bool FrameSource::exhausted() const {
+    return false;
+}
+
+bool FrameSource::paced() const {
+    return true;
+}
+
+uint64_t FrameSource::droppedFrames() const {
+    return 0;
+}
+
+const vector<SceneTag>* FrameSource::groundTruth() const {
+    return nullptr;
+}
+
+DeviceSource::DeviceSource(const SourceConfig& config) {
+    this->color = config.color;
+
+    // Explicitly V4L2, whose CAP_PROP_POS_MSEC is the buffer timestamp rather than a stream position.
+    capture.open(config.path, CAP_V4L2);
+
+    capture.set(CAP_PROP_FRAME_WIDTH, config.width);
+    capture.set(CAP_PROP_FRAME_HEIGHT, config.height);
+    capture.set(CAP_PROP_FPS, config.fps);
+    // Keep as few frames queued in the driver as it allows, so a read returns a fresh one.
+    capture.set(CAP_PROP_BUFFERSIZE, 1);
+}
+
+bool DeviceSource::read(Mat& image, int64_t& timestamp) {
+    if (color) {
+        if (!capture.read(image)) {
+            return false;
+        }
+    } else {
+        if (!capture.read(captured)) {
+            return false;
+        }
+        cvtColor(captured, image, COLOR_BGR2GRAY);
+    }
+
+    timestamp = nt::Now();
+
+    double bufferMillis = capture.get(CAP_PROP_POS_MSEC);
+    if (bufferMillis > 0) {
+        int64_t bufferTime = clock.toNtTime(static_cast<int64_t>(bufferMillis * 1000));
+
+        if (bufferTime <= timestamp && timestamp - bufferTime < maxBufferAgeMicros) {
+            timestamp = bufferTime;
+        } else {
+            LOG_WARNING("Buffer timestamp %.3f ms isn't on CLOCK_MONOTONIC, stamping at read instead", bufferMillis);
+        }
+    }
+
+    return true;
+}
+
+ReplaySource::ReplaySource(const SourceConfig& config) {
+    this->config = config;
+    this->finished = false;
+    this->sourceStart = -1;
+    this->replayStart = 0;
+}
+
+bool ReplaySource::exhausted() const {
+    return finished;
+}
+
+bool ReplaySource::paced() const {
+    return config.realtime;
+}
+
+int64_t ReplaySource::pace(int64_t sourceMicros) {
+    if (sourceStart < 0) {
+        sourceStart = sourceMicros;
+        replayStart = nt::Now();
+    }
+
+    if (!config.realtime) {
+        return nt::Now();
+    }
+
+    int64_t target = replayStart + (sourceMicros - sourceStart);
+    int64_t wait = target - nt::Now();
+    if (wait > 0) {
+        this_thread::sleep_for(chrono::microseconds(wait));
+    }
+
+    return target;
+}
+
+void ReplaySource::restart() {
+    sourceStart = -1;
+}
+
+VideoFileSource::VideoFileSource(const SourceConfig& config):
+ReplaySource(config) {
+    capture.open(config.path);
+}
+
+bool VideoFileSource::readFrame(Mat& image) {
+    if (config.color) {
+        return capture.read(image);
+    }
+
+    if (!capture.read(captured)) {
+        return false;
+    }
+
+    cvtColor(captured, image, COLOR_BGR2GRAY);
+    return true;
+}
+
+bool VideoFileSource::read(Mat& image, int64_t& timestamp) {
+    if (finished) {
+        return false;
+    }
+
+    if (!readFrame(image)) {
+        if (!config.loop) {
+            finished = true;
+            return false;
+        }
+
+        capture.set(CAP_PROP_POS_FRAMES, 0);
+        restart();
+
+        if (!readFrame(image)) {
+            finished = true;
+            return false;
+        }
+    }
+
+    timestamp = pace(static_cast<int64_t>(capture.get(CAP_PROP_POS_MSEC) * 1000));
+    return true;
+}
+
+ImageSequenceSource::ImageSequenceSource(const SourceConfig& config, vector<string> framePaths,
+    vector<int64_t> frameTimes):
+ReplaySource(config) {
+    this->framePaths = move(framePaths);
+    this->frameTimes = move(frameTimes);
+    this->nextFrame = 0;
+}
+
+bool ImageSequenceSource::read(Mat& image, int64_t& timestamp) {
+    if (finished) {
+        return false;
+    }
+
+    if (nextFrame == framePaths.size()) {
+        if (!config.loop || framePaths.empty()) {
+            finished = true;
+            return false;
+        }
+
+        nextFrame = 0;
+        restart();
+    }
+
+    const string& path = framePaths[nextFrame];
+
+    if (filesystem::path(path).extension() == ".raw") {
+        image.create(config.height, config.width, CV_8UC1);
+
+        ifstream raw(path, ios::binary);
+        raw.read(reinterpret_cast<char*>(image.data), static_cast<streamsize>(image.total()));
+
+        if (!raw) {
+            image.release();
+        }
+    } else {
+        // Decoding straight to grayscale skips the chroma planes entirely.
+        image = imread(path, config.color ? IMREAD_COLOR : IMREAD_GRAYSCALE);
+    }
+
+    timestamp = pace(frameTimes[nextFrame]);
+    nextFrame += 1;
+
+    return !image.empty();
+}
+
+MemorySource::MemorySource(const vector<Mat>* images, int frameCount, const vector<vector<SceneTag>>* truths) {
+    this->images = images;
+    this->truths = truths;
+    this->frameCount = images->empty() ? 0 : frameCount;
+
+    nextFrame = 0;
+}
+
+bool MemorySource::read(Mat& image, int64_t& timestamp) {
+    if (nextFrame >= frameCount) {
+        return false;
+    }
+
+    // Copy like a real capture would, so the slot's buffers never alias the preloaded frames.
+    (*images)[nextFrame % images->size()].copyTo(image);
+    timestamp = nt::Now();
+    nextFrame += 1;
+
+    return true;
+}
+
+bool MemorySource::exhausted() const {
+    return nextFrame >= frameCount;
+}
+
+bool MemorySource::paced() const {
+    return false;
+}
+
+const vector<SceneTag>* MemorySource::groundTruth() const {
+    if (truths == nullptr || nextFrame == 0) {
+        return nullptr;
+    }
+
+    return &(*truths)[(nextFrame - 1) % truths->size()];
+}
+
+static SceneConfig sourceScene(const SourceConfig& config) {
+    SceneConfig scene = config.scene;
+    scene.color = config.color;
+
+    return scene;
+}
+
+SyntheticSource::SyntheticSource(const SourceConfig& config):
+generator(sourceScene(config)) {
+    this->config = config;
+    this->nextFrameTime = 0;
+}
+
+bool SyntheticSource::read(Mat& image, int64_t& timestamp) {
+    if (config.realtime && config.fps > 0) {
+        int64_t now = nt::Now();
+        if (nextFrameTime == 0) {
+            nextFrameTime = now;
+        }
+
+        if (nextFrameTime > now) {
+            this_thread::sleep_for(chrono::microseconds(nextFrameTime - now));
+        }
+        nextFrameTime += static_cast<int64_t>(1e6 / config.fps);
+    }
+
+    timestamp = nt::Now();
+    generator.generate(tags, image);
+
+    return true;
+}
+
+bool SyntheticSource::paced() const {
+    return config.realtime;
+}
+
+const vector<SceneTag>* SyntheticSource::groundTruth() const {
+    return &tags;
+}
+
+static bool isImageFile(const filesystem::path& path) {
+    string extension = path.extension().string();
+    transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return tolower(c); });
+
+    return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".bmp" ||
+        extension == ".pgm" || extension == ".raw";
+}
+
+static unique_ptr<FrameSource> createImageDirectorySource(const SourceConfig& config) {
+    vector<string> framePaths;
+    for (const filesystem::directory_entry& entry : filesystem::directory_iterator(config.path)) {
+        if (entry.is_regular_file() && isImageFile(entry.path())) {
+            framePaths.push_back(entry.path().string());
+        }
+    }
+    sort(framePaths.begin(), framePaths.end());
+
+    double fps = config.fps > 0 ? config.fps : 30;
+
+    vector<int64_t> frameTimes;
+    for (int i = 0; i < framePaths.size(); i++) {
+        frameTimes.push_back(static_cast<int64_t>(i * 1e6 / fps));
+    }
+
+    return make_unique<ImageSequenceSource>(config, move(framePaths), move(frameTimes));
+}
+
+static unique_ptr<FrameSource> createCaptureLogSource(const SourceConfig& config) {
+    filesystem::path logDirectory = filesystem::path(config.path).parent_path();
+
+    vector<string> framePaths;
+    vector<int64_t> frameTimes;
+
+    ifstream log(config.path);
+    int64_t frameTime;
+    string framePath;
+
+    while (log >> frameTime >> framePath) {
+        frameTimes.push_back(frameTime);
+        framePaths.push_back((logDirectory / framePath).string());
+    }
+
+    return make_unique<ImageSequenceSource>(config, move(framePaths), move(frameTimes));
+}
+
+unique_ptr<FrameSource> createFrameSource(const SourceConfig& config) {
+    if (config.type == "video") {
+        return make_unique<VideoFileSource>(config);
+    } else if (config.type == "images") {
+        return createImageDirectorySource(config);
+    } else if (config.type == "log") {
+        return createCaptureLogSource(config);
+    } else if (config.type == "synthetic") {
+        return make_unique<SyntheticSource>(config);
+    } else if (config.type == "v4l2") {
+        return make_unique<V4l2Source>(config);
+    }
+
+    return make_unique<DeviceSource>(config);
+}
+
+vector<Mat> preloadFrames(SourceConfig sourceConfig, int maxFrames, vector<vector<SceneTag>>* truths) {
+    unique_ptr<FrameSource> source = createFrameSource(sourceConfig);
+
+    vector<Mat> images;
+    int failures = 0;
+
+    while (images.size() < maxFrames && !source->exhausted() && failures < 100) {
+        Mat image;
+        int64_t timestamp;
+
+        if (source->read(image, timestamp) && !image.empty()) {
+            images.push_back(image);
+
+            if (truths != nullptr && source->groundTruth() != nullptr) {
+                truths->push_back(*source->groundTruth());
+            }
+        } else {
+            failures += 1;
+        }
+    }
+
+    return images;
+}
@@ -0,0 +1,185 @@
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "SceneGenerator.h"
+
+struct SourceConfig {
+    // "device" (OpenCV VideoCapture), "v4l2" (native grayscale capture), "video", "images", "log" or "synthetic"
+    std::string type;
+    std::string path;
+
+    int width;
+    int height;
+    // What v4l2 sources ask the camera for: "YUYV" or "MJPG".
+    std::string pixelFormat;
+    // Capture rate for devices, playback rate for image directories.
+    double fps;
+
+    // Replays pace frames at their original spacing when true, and run as fast as the pipeline pulls them otherwise.
+    bool realtime;
+    bool loop;
+
+    // Frames are 8-bit grayscale, all detection needs, unless this asks for BGR, e.g. for a debug stream. v4l2 sources
+    // are always grayscale.
+    bool color;
+
+    // What a synthetic source renders.
+    SceneConfig scene;
+
+    // Frames older than this by the time a worker claims them are dropped rather than detected. 0 keeps every frame.
+    int64_t maxFrameAgeMicros;
+
+    SourceConfig();
+};
+
+// Maps CLOCK_MONOTONIC microseconds, the clock V4L2 stamps buffers with, onto the NetworkTables clock. The offset is
+// re-measured every second from the tightest of a few back-to-back readings of both clocks.
+class CaptureClock {
+    public:
+        CaptureClock();
+
+        int64_t toNtTime(int64_t monotonicMicros);
+
+        static int64_t monotonicNow();
+    private:
+        int64_t offset;
+        int64_t nextSync;
+
+        void sync();
+};
+
+// Where a Camera's capture thread gets its frames from: a V4L2 device on the robot, or a recording for replay.
+class FrameSource {
+    public:
+        virtual ~FrameSource() = default;
+
+        // Reads the next frame, stamping it in the NetworkTables time base. Returns false if no frame was produced.
+        virtual bool read(cv::Mat& image, int64_t& timestamp) = 0;
+
+        // True once a replay has run out of frames and won't produce any more.
+        virtual bool exhausted() const;
+
+        // True when frames arrive on the source's own clock (a live camera or a real-time replay), so an unclaimed frame
+        // may be replaced by a newer one. Unpaced replays hand every frame to a worker instead.
+        virtual bool paced() const;
+
+        // Frames the source threw away itself, to hand out the newest one instead of older queued ones.
+        virtual uint64_t droppedFrames() const;
+
+        // The tags in the frame read last, for sources that rendered it themselves; nullptr for everything else.
+        virtual const std::vector<SceneTag>* groundTruth() const;
+};
+
+// Stamps frames with the driver's buffer timestamp, taken when the frame arrived from the camera, rather than when
+// read() returned, so the stamp doesn't include time the frame spent queued in the driver.
+class DeviceSource : public FrameSource {
+    public:
+        explicit DeviceSource(const SourceConfig& config);
+
+        bool read(cv::Mat& image, int64_t& timestamp) override;
+    private:
+        cv::VideoCapture capture;
+        CaptureClock clock;
+        bool color;
+        // VideoCapture only hands out BGR; grayscale frames are converted from here into the frame's own buffer.
+        cv::Mat captured;
+};
+
+// Maps recorded frame times onto the NetworkTables clock, sleeping to keep real-time spacing when asked to.
+class ReplaySource : public FrameSource {
+    public:
+        explicit ReplaySource(const SourceConfig& config);
+
+        bool exhausted() const override;
+        bool paced() const override;
+    protected:
+        SourceConfig config;
+        bool finished;
+
+        int64_t pace(int64_t sourceMicros);
+        void restart();
+    private:
+        int64_t sourceStart;
+        int64_t replayStart;
+};
+
+class VideoFileSource : public ReplaySource {
+    public:
+        explicit VideoFileSource(const SourceConfig& config);
+
+        bool read(cv::Mat& image, int64_t& timestamp) override;
+    private:
+        cv::VideoCapture capture;
+        cv::Mat captured;
+
+        bool readFrame(cv::Mat& image);
+};
+
+// A list of image files with their recorded capture times in microseconds. Files ending in .raw are read as 8-bit
+// grayscale frames of the configured width and height.
+class ImageSequenceSource : public ReplaySource {
+    public:
+        ImageSequenceSource(const SourceConfig& config, std::vector<std::string> framePaths,
+            std::vector<int64_t> frameTimes);
+
+        bool read(cv::Mat& image, int64_t& timestamp) override;
+    private:
+        std::vector<std::string> framePaths;
+        std::vector<int64_t> frameTimes;
+        int nextFrame;
+};
+
+// Replays frames already held in memory back to back, unpaced, so benchmarks measure the pipeline rather than disk
+// reads or decoding. Stops after frameCount frames, cycling through the list as needed: read n, counting from 0, is
+// images[n % images.size()]. truths, when given, holds each image's ground truth.
+class MemorySource : public FrameSource {
+    public:
+        MemorySource(const std::vector<cv::Mat>* images, int frameCount,
+            const std::vector<std::vector<SceneTag>>* truths = nullptr);
+
+        bool read(cv::Mat& image, int64_t& timestamp) override;
+        bool exhausted() const override;
+        bool paced() const override;
+        const std::vector<SceneTag>* groundTruth() const override;
+    private:
+        const std::vector<cv::Mat>* images;
+        const std::vector<std::vector<SceneTag>>* truths;
+        int frameCount;
+        int nextFrame;
+};
+
+// Renders random tag scenes, one new scene per frame, at config.fps when realtime and as fast as they're pulled
+// otherwise.
+class SyntheticSource : public FrameSource {
+    public:
+        explicit SyntheticSource(const SourceConfig& config);
+
+        bool read(cv::Mat& image, int64_t& timestamp) override;
+        bool paced() const override;
+        const std::vector<SceneTag>* groundTruth() const override;
+    private:
+        SourceConfig config;
+        SceneGenerator generator;
+        std::vector<SceneTag> tags;
+        int64_t nextFrameTime;
+};
+
+// Builds the source for a camera. "images" replays every PNG/JPEG/BMP/PGM/raw file in the directory at path in file
+// name order at config.fps. "log" replays a capture log: one "<capture timestamp in microseconds> <frame path>" line
+// per frame, with paths relative to the log file, keeping the original frame spacing.
+std::unique_ptr<FrameSource> createFrameSource(const SourceConfig& config);
+
+// Reads up to maxFrames frames from a new source for config, for benchmarks to replay from memory. When the source
+// knows each frame's tags, they're added to truths, one entry per frame, if it's given.
+std::vector<cv::Mat> preloadFrames(SourceConfig sourceConfig, int maxFrames,
+    std::vector<std::vector<SceneTag>>* truths = nullptr);
+
+#endif //FRAMESOURCE_H
@@ -0,0 +1,163 @@
+#include "Log.h"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <ctime>
+#include <thread>
+
+using namespace std;
+
+static constexpr int64_t siteIntervalMicros = 1000000;
+static constexpr size_t queueCapacity = 1024;
+static constexpr size_t messageLength = 232;
+
+// A slot of Vyukov's bounded queue. Its sequence says whose turn the slot is: a producer may fill it when it equals the
+// producer's position, the writer may read it when it equals that position plus one. It's stored less the slot's
+// index, so the zero-initialized table already has every slot free for the first lap.
+struct LogEntry {
+    atomic<size_t> sequence;
+    int64_t time;
+    LogLevel level;
+    int suppressed;
+    char message[messageLength];
+};
+
+// Constant initialized, so it's ready before any dynamic initializer runs and messages logged from one, or before
+// start(), wait in the queue instead of corrupting it.
+static constinit LogEntry entries[queueCapacity];
+
+static size_t loadSequence(const LogEntry& entry, size_t position, memory_order order) {
+    return entry.sequence.load(order) + position % queueCapacity;
+}
+
+static void storeSequence(LogEntry& entry, size_t position, size_t sequence, memory_order order) {
+    entry.sequence.store(sequence - position % queueCapacity, order);
+}
+
+static atomic<size_t> enqueuePosition(0);
+static size_t dequeuePosition = 0;
+
+static atomic<uint64_t> accepted(0);
+static atomic<uint64_t> written(0);
+static atomic<uint64_t> dropped(0);
+
+static int64_t wallMicros() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static const char* levelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug:
+            return "DEBUG";
+        case LogLevel::Info:
+            return "INFO";
+        case LogLevel::Warning:
+            return "WARN";
+        default:
+            return "ERROR";
+    }
+}
+
+static void writeEntry(const LogEntry& entry) {
+    time_t seconds = static_cast<time_t>(entry.time / 1000000);
+    tm local;
+    localtime_r(&seconds, &local);
+
+    char stamp[16];
+    strftime(stamp, sizeof(stamp), "%H:%M:%S", &local);
+
+    if (entry.suppressed > 0) {
+        fprintf(stderr, "%s.%03d %-5s %s (%d similar suppressed)\n", stamp, static_cast<int>(entry.time / 1000 % 1000),
+            levelName(entry.level), entry.message, entry.suppressed);
+    } else {
+        fprintf(stderr, "%s.%03d %-5s %s\n", stamp, static_cast<int>(entry.time / 1000 % 1000), levelName(entry.level),
+            entry.message);
+    }
+}
+
+static void writerLoop() {
+    while (true) {
+        bool wroteAny = false;
+
+        while (true) {
+            LogEntry& entry = entries[dequeuePosition % queueCapacity];
+            if (loadSequence(entry, dequeuePosition, memory_order_acquire) != dequeuePosition + 1) {
+                break;
+            }
+
+            writeEntry(entry);
+            storeSequence(entry, dequeuePosition, dequeuePosition + queueCapacity, memory_order_release);
+            dequeuePosition += 1;
+
+            written.fetch_add(1, memory_order_release);
+            wroteAny = true;
+        }
+
+        uint64_t lost = dropped.exchange(0);
+        if (lost > 0) {
+            fprintf(stderr, "Log queue full, dropped %llu messages\n", static_cast<unsigned long long>(lost));
+            wroteAny = true;
+        }
+
+        // Polling keeps producers from ever making a syscall to wake the writer.
+        if (wroteAny) {
+            fflush(stderr);
+        } else {
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+    }
+}
+
+void Log::start() {
+    thread(writerLoop).detach();
+}
+
+void Log::write(LogSite& site, LogLevel level, const char* format, ...) {
+    int64_t now = wallMicros();
+
+    int64_t allowedAt = site.nextAllowed.load(memory_order_relaxed);
+    if (now < allowedAt || !site.nextAllowed.compare_exchange_strong(allowedAt, now + siteIntervalMicros,
+        memory_order_relaxed)) {
+        site.suppressed.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    size_t position = enqueuePosition.load(memory_order_relaxed);
+    LogEntry* entry;
+    while (true) {
+        entry = &entries[position % queueCapacity];
+        size_t sequence = loadSequence(*entry, position, memory_order_acquire);
+
+        if (sequence == position) {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, memory_order_relaxed)) {
+                break;
+            }
+        } else if (sequence < position) {
+            dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        } else {
+            position = enqueuePosition.load(memory_order_relaxed);
+        }
+    }
+
+    entry->time = now;
+    entry->level = level;
+    entry->suppressed = site.suppressed.exchange(0, memory_order_relaxed);
+
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(entry->message, messageLength, format, arguments);
+    va_end(arguments);
+
+    storeSequence(*entry, position, position + 1, memory_order_release);
+    accepted.fetch_add(1, memory_order_relaxed);
+}
+
+void Log::flush() {
+    uint64_t target = accepted.load();
+    while (written.load(memory_order_acquire) < target) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    fflush(stderr);
+}
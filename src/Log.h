@@ -0,0 +1,72 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <cstdint>
+
+// Lowest level compiled in: 0 debug, 1 info, 2 warning, 3 error. Statements below it compile to nothing, arguments
+// included.
+#ifndef FISHEYE_LOG_LEVEL
+#define FISHEYE_LOG_LEVEL 1
+#endif
+
+enum class LogLevel {
+    Debug = 0,
+    Info = 1,
+    Warning = 2,
+    Error = 3
+};
+
+// One per log statement. Lets the statement through at most once per second and counts the messages held back, so a
+// per-frame message can't flood the console.
+struct LogSite {
+    std::atomic<int64_t> nextAllowed;
+    std::atomic<int> suppressed;
+
+    constexpr LogSite(): nextAllowed(0), suppressed(0) {}
+};
+
+// Asynchronous logging to stderr. Callers format into a slot of a fixed size lock-free queue and return; a background
+// thread does the writing and flushing. Messages are dropped, and counted, if the queue is full.
+class Log {
+    public:
+        // Starts the writer thread. Messages may be logged before, and are written once it runs.
+        static void start();
+
+        static void write(LogSite& site, LogLevel level, const char* format, ...)
+            __attribute__((format(printf, 3, 4)));
+
+        // Blocks until every message accepted so far has been written.
+        static void flush();
+};
+
+#define FISHEYE_LOG(level, ...) do { \
+    static LogSite fisheyeLogSite; \
+    Log::write(fisheyeLogSite, level, __VA_ARGS__); \
+} while (false)
+
+#if FISHEYE_LOG_LEVEL <= 0
+#define LOG_DEBUG(...) FISHEYE_LOG(LogLevel::Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (false)
+#endif
+
+#if FISHEYE_LOG_LEVEL <= 1
+#define LOG_INFO(...) FISHEYE_LOG(LogLevel::Info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (false)
+#endif
+
+#if FISHEYE_LOG_LEVEL <= 2
+#define LOG_WARNING(...) FISHEYE_LOG(LogLevel::Warning, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) do {} while (false)
+#endif
+
+#if FISHEYE_LOG_LEVEL <= 3
+#define LOG_ERROR(...) FISHEYE_LOG(LogLevel::Error, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (false)
+#endif
+
+#endif //LOG_H
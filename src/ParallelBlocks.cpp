@@ -0,0 +1,62 @@
+#include "ParallelBlocks.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+// Shared with the helper tasks, which may only get to run after parallelBlocks has returned. They touch block only
+// after claiming an index, and the caller doesn't return until every claimed index is done.
+struct BlockState {
+    atomic<int> next;
+    atomic<int> finished;
+    int count;
+    const function<void(int)>* block;
+
+    mutex stateMutex;
+    condition_variable stateCondition;
+};
+
+static void runBlocks(BlockState& state) {
+    while (true) {
+        int index = state.next.fetch_add(1);
+        if (index >= state.count) {
+            return;
+        }
+
+        (*state.block)(index);
+
+        if (state.finished.fetch_add(1) + 1 == state.count) {
+            lock_guard<mutex> lock(state.stateMutex);
+            state.stateCondition.notify_all();
+        }
+    }
+}
+
+void parallelBlocks(BS::thread_pool* pool, int count, const function<void(int)>& block) {
+    if (pool == nullptr || count <= 1) {
+        for (int i = 0; i < count; i++) {
+            block(i);
+        }
+        return;
+    }
+
+    shared_ptr<BlockState> state = make_shared<BlockState>();
+    state->next.store(0);
+    state->finished.store(0);
+    state->count = count;
+    state->block = &block;
+
+    int helpers = min(count - 1, static_cast<int>(pool->get_thread_count()));
+    pool->detach_blocks(0, helpers, [state](int, int) {
+        runBlocks(*state);
+    }, helpers);
+
+    runBlocks(*state);
+
+    unique_lock<mutex> lock(state->stateMutex);
+    state->stateCondition.wait(lock, [&state] { return state->finished.load() == state->count; });
+}
@@ -0,0 +1,13 @@
+#ifndef PARALLELBLOCKS_H
+#define PARALLELBLOCKS_H
+
+#include <functional>
+
+#include "../include/BS_thread_pool.hpp"
+
+// Runs block(0) through block(count - 1) spread across the pool and the calling thread, and returns once every block
+// has finished. The caller takes blocks itself and only ever waits on blocks another thread is already running, so it
+// can be called from inside a pool task even when every other worker is busy. Runs everything inline without a pool.
+void parallelBlocks(BS::thread_pool* pool, int count, const std::function<void(int)>& block);
+
+#endif //PARALLELBLOCKS_H
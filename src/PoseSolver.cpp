@@ -0,0 +1,307 @@
+#include "PoseSolver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <opencv2/calib3d.hpp>
+
+using namespace std;
+using namespace cv;
+
+// Rotation taking a onto the +z axis.
+static Matx33d rotateToZAxis(const Vec3d& a) {
+    Vec3d n = a / norm(a);
+
+    if (abs(1.0 + n(2)) < numeric_limits<float>::epsilon()) {
+        return Matx33d(1, 0, 0, 0, 1, 0, 0, 0, -1);
+    }
+
+    double d = 1.0 / (1.0 + n(2));
+
+    return Matx33d(1.0 - n(0) * n(0) * d, -n(0) * n(1) * d, -n(0),
+        -n(0) * n(1) * d, 1.0 - n(1) * n(1) * d, -n(1),
+        n(0), n(1), 1.0 - (n(0) * n(0) + n(1) * n(1)) * d);
+}
+
+// Homography from the tag plane, corners at (-h, h), (h, h), (h, -h), (-h, -h), onto the four image points: the unit
+// square's, composed with the map from the tag square onto the unit square.
+static bool squareHomography(const Point2f* points, double halfLength, Matx33d& homography) {
+    Matx33d unitSquare;
+    if (!unitSquareHomography(points, unitSquare)) {
+        return false;
+    }
+
+    Matx33d tagToUnit(0.5 / halfLength, 0, 0.5,
+        0, -0.5 / halfLength, 0.5,
+        0, 0, 1);
+
+    homography = unitSquare * tagToUnit;
+
+    if (abs(homography(2, 2)) < 1e-12) {
+        return false;
+    }
+
+    homography = homography * (1.0 / homography(2, 2));
+    return true;
+}
+
+// The two IPPE rotations from the homography's Jacobian J at the tag center and the center's image point (p, q).
+static bool computeRotations(const Matx22d& J, double p, double q, Matx33d& first, Matx33d& second) {
+    Matx33d Rv = rotateToZAxis(Vec3d(p, q, 1)).t();
+
+    Matx22d B(Rv(0, 0) - p * Rv(2, 0), Rv(0, 1) - p * Rv(2, 1),
+        Rv(1, 0) - q * Rv(2, 0), Rv(1, 1) - q * Rv(2, 1));
+
+    double det = B(0, 0) * B(1, 1) - B(0, 1) * B(1, 0);
+    if (abs(det) < 1e-12) {
+        return false;
+    }
+
+    Matx22d A = Matx22d(B(1, 1), -B(0, 1), -B(1, 0), B(0, 0)) * (1.0 / det) * J;
+
+    // Largest singular value of A.
+    double ata00 = A(0, 0) * A(0, 0) + A(0, 1) * A(0, 1);
+    double ata01 = A(0, 0) * A(1, 0) + A(0, 1) * A(1, 1);
+    double ata11 = A(1, 0) * A(1, 0) + A(1, 1) * A(1, 1);
+
+    double gamma = sqrt(0.5 * (ata00 + ata11 + sqrt((ata00 - ata11) * (ata00 - ata11) + 4.0 * ata01 * ata01)));
+    if (gamma < numeric_limits<float>::epsilon()) {
+        return false;
+    }
+
+    Matx22d R = A * (1.0 / gamma);
+
+    double b0 = sqrt(max(0.0, 1.0 - R(0, 0) * R(0, 0) - R(1, 0) * R(1, 0)));
+    double b1 = sqrt(max(0.0, 1.0 - R(0, 1) * R(0, 1) - R(1, 1) * R(1, 1)));
+
+    if (-R(0, 0) * R(0, 1) - R(1, 0) * R(1, 1) < 0) {
+        b1 = -b1;
+    }
+
+    for (int solution = 0; solution < 2; solution++) {
+        double sign = solution == 0 ? 1.0 : -1.0;
+
+        Vec3d x(R(0, 0), R(1, 0), sign * b0);
+        Vec3d y(R(0, 1), R(1, 1), sign * b1);
+        Vec3d z = x.cross(y);
+
+        Matx33d rotation = Rv * Matx33d(x(0), y(0), z(0),
+            x(1), y(1), z(1),
+            x(2), y(2), z(2));
+
+        if (solution == 0) {
+            first = rotation;
+        } else {
+            second = rotation;
+        }
+    }
+
+    return true;
+}
+
+static Point3d tagCorner(int index, double halfLength) {
+    return Point3d(index == 0 || index == 3 ? -halfLength : halfLength,
+        index == 0 || index == 1 ? halfLength : -halfLength, 0);
+}
+
+// Least squares translation for a known rotation, from the normal equations of u * (r3.X + tz) = r1.X + tx and
+// v * (r3.X + tz) = r2.X + ty.
+static Matx31d computeTranslation(const Point2f* points, const Matx33d& rotation, double halfLength) {
+    Matx33d ata = Matx33d::zeros();
+    Matx31d atb = Matx31d::zeros();
+
+    for (int i = 0; i < 4; i++) {
+        Point3d corner = tagCorner(i, halfLength);
+        double u = points[i].x, v = points[i].y;
+
+        double rx = rotation(0, 0) * corner.x + rotation(0, 1) * corner.y;
+        double ry = rotation(1, 0) * corner.x + rotation(1, 1) * corner.y;
+        double rz = rotation(2, 0) * corner.x + rotation(2, 1) * corner.y;
+
+        double bx = u * rz - rx;
+        double by = v * rz - ry;
+
+        ata(0, 0) += 1;
+        ata(1, 1) += 1;
+        ata(0, 2) -= u;
+        ata(1, 2) -= v;
+        ata(2, 2) += u * u + v * v;
+
+        atb(0) += bx;
+        atb(1) += by;
+        atb(2) -= u * bx + v * by;
+    }
+
+    ata(2, 0) = ata(0, 2);
+    ata(2, 1) = ata(1, 2);
+
+    return ata.solve(atb, DECOMP_CHOLESKY);
+}
+
+static double squaredReprojectionError(const Point2f* points, const Matx33d& rotation, const Matx31d& translation,
+    double halfLength) {
+    double error = 0;
+
+    for (int i = 0; i < 4; i++) {
+        Point3d corner = tagCorner(i, halfLength);
+        Matx31d camera = rotation * Matx31d(corner.x, corner.y, 0) + translation;
+
+        double du = camera(0) / camera(2) - points[i].x;
+        double dv = camera(1) / camera(2) - points[i].y;
+        error += du * du + dv * dv;
+    }
+
+    return error;
+}
+
+PoseSolver::PoseSolver(const Mat& cameraMatrix, const Mat& distortionCoefficients, double tagSize) {
+    this->cameraMatrix = cameraMatrix.clone();
+    this->distortionCoefficients = distortionCoefficients.clone();
+
+    this->halfLength = tagSize / 2;
+    this->focalLength = (cameraMatrix.at<double>(0, 0) + cameraMatrix.at<double>(1, 1)) / 2;
+
+    this->fx = cameraMatrix.at<double>(0, 0);
+    this->fy = cameraMatrix.at<double>(1, 1);
+    this->cx = cameraMatrix.at<double>(0, 2);
+    this->cy = cameraMatrix.at<double>(1, 2);
+    for (int i = 0; i < 5; i++) {
+        this->k[i] = distortionCoefficients.at<double>(i);
+    }
+}
+
+bool PoseSolver::solveSquare(const Point2f* points, Pose& pose, double& error) const {
+    Matx33d H;
+    if (!squareHomography(points, halfLength, H)) {
+        return false;
+    }
+
+    Matx22d J(H(0, 0) - H(2, 0) * H(0, 2), H(0, 1) - H(2, 1) * H(0, 2),
+        H(1, 0) - H(2, 0) * H(1, 2), H(1, 1) - H(2, 1) * H(1, 2));
+
+    Matx33d rotations[2];
+    if (!computeRotations(J, H(0, 2), H(1, 2), rotations[0], rotations[1])) {
+        return false;
+    }
+
+    double bestError = numeric_limits<double>::infinity();
+
+    for (const Matx33d& rotation : rotations) {
+        Matx31d translation = computeTranslation(points, rotation, halfLength);
+        double candidateError = squaredReprojectionError(points, rotation, translation, halfLength);
+
+        if (candidateError < bestError) {
+            bestError = candidateError;
+
+            pose.rmat = rotation.t();
+            pose.tvec = -(pose.rmat * translation);
+        }
+    }
+
+    error = sqrt(bestError / 4) * focalLength;
+    return isfinite(error);
+}
+
+void PoseSolver::undistort(const vector<Point2f>& distorted, vector<Point2f>& normalized) const {
+    normalized.resize(distorted.size());
+
+    for (int i = 0; i < distorted.size(); i++) {
+        double x0 = (distorted[i].x - cx) / fx;
+        double y0 = (distorted[i].y - cy) / fy;
+        double x = x0, y = y0;
+
+        for (int iteration = 0; iteration < 5; iteration++) {
+            double r2 = x * x + y * y;
+            double inverse = 1.0 / (1.0 + ((k[4] * r2 + k[1]) * r2 + k[0]) * r2);
+            // Diverging; undistortPoints gives up on the point the same way.
+            if (inverse < 0) {
+                x = x0;
+                y = y0;
+                break;
+            }
+
+            double deltaX = 2 * k[2] * x * y + k[3] * (r2 + 2 * x * x);
+            double deltaY = k[2] * (r2 + 2 * y * y) + 2 * k[3] * x * y;
+
+            x = (x0 - deltaX) * inverse;
+            y = (y0 - deltaY) * inverse;
+        }
+
+        normalized[i] = Point2f(static_cast<float>(x), static_cast<float>(y));
+    }
+}
+
+void PoseSolver::solve(FrameScratch& scratch) const {
+    scratch.poses.resize(scratch.tagCount);
+    scratch.reprojectionErrors.resize(scratch.tagCount);
+
+    if (scratch.tagCount == 0) {
+        return;
+    }
+
+    scratch.distortedCorners.resize(scratch.tagCount * 4);
+    for (int i = 0; i < scratch.tagCount; i++) {
+        copy(scratch.apriltags[i].corners.begin(), scratch.apriltags[i].corners.end(),
+            scratch.distortedCorners.begin() + i * 4);
+    }
+
+    undistort(scratch.distortedCorners, scratch.normalizedCorners);
+
+    for (int i = 0; i < scratch.tagCount; i++) {
+        if (!solveSquare(&scratch.normalizedCorners[i * 4], scratch.poses[i], scratch.reprojectionErrors[i])) {
+            scratch.reprojectionErrors[i] = numeric_limits<double>::infinity();
+        }
+    }
+}
+
+bool PoseSolver::solveField(const FieldLayout& layout, FrameScratch& scratch) const {
+    scratch.fieldPoints.clear();
+    scratch.fieldImagePoints.clear();
+    scratch.fieldTagCount = 0;
+
+    for (int i = 0; i < scratch.tagCount; i++) {
+        const array<Point3d, 4>* corners = layout.tagCorners(scratch.apriltags[i].id);
+
+        if (corners == nullptr || !isfinite(scratch.reprojectionErrors[i])) {
+            continue;
+        }
+
+        for (int b = 0; b < 4; b++) {
+            scratch.fieldPoints.push_back((*corners)[b]);
+            scratch.fieldImagePoints.emplace_back(scratch.normalizedCorners[i * 4 + b].x,
+                scratch.normalizedCorners[i * 4 + b].y);
+        }
+        scratch.fieldTagCount += 1;
+    }
+
+    if (scratch.fieldTagCount == 0) {
+        return false;
+    }
+
+    // Corners are already undistorted and normalized by solve(), so the camera is the identity here.
+    Matx31d rvec, tvec;
+    if (!solvePnP(scratch.fieldPoints, scratch.fieldImagePoints, Matx33d::eye(), noArray(), rvec, tvec, false,
+        SOLVEPNP_SQPNP)) {
+        return false;
+    }
+
+    Matx33d rotation;
+    Rodrigues(rvec, rotation);
+
+    double error = 0;
+    for (int i = 0; i < scratch.fieldPoints.size(); i++) {
+        const Point3d& point = scratch.fieldPoints[i];
+        Matx31d camera = rotation * Matx31d(point.x, point.y, point.z) + tvec;
+
+        double du = camera(0) / camera(2) - scratch.fieldImagePoints[i].x;
+        double dv = camera(1) / camera(2) - scratch.fieldImagePoints[i].y;
+        error += du * du + dv * dv;
+    }
+
+    scratch.fieldPose.rmat = rotation.t();
+    scratch.fieldPose.tvec = -(scratch.fieldPose.rmat * tvec);
+    scratch.fieldReprojectionError = sqrt(error / static_cast<double>(scratch.fieldPoints.size())) * focalLength;
+
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef POSESOLVER_H
+#define POSESOLVER_H
+
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/matx.hpp>
+#include <opencv2/core/types.hpp>
+
+#include "FieldLayout.h"
+#include "Utils.h"
+
+// Closed-form IPPE solver for square tags (Collins & Bartoli, "Infinitesimal Plane-Based Pose Estimation", 2014).
+// Solves every tag of a frame in one call with fixed-size math, undistorting all corners in a single pass.
+class PoseSolver {
+    public:
+        PoseSolver(const cv::Mat& cameraMatrix, const cv::Mat& distortionCoefficients, double tagSize);
+
+        // Fills scratch.poses with camera-in-tag poses and scratch.reprojectionErrors with the RMS corner error in
+        // pixels. Tags that can't be solved get an infinite error.
+        void solve(FrameScratch& scratch) const;
+
+        // Solves one camera-in-field pose from the corners of every solved tag in the layout at once, filling
+        // scratch.fieldPose, fieldReprojectionError and fieldTagCount. Must run after solve().
+        bool solveField(const FieldLayout& layout, FrameScratch& scratch) const;
+    private:
+        cv::Mat cameraMatrix;
+        cv::Mat distortionCoefficients;
+
+        double halfLength;
+        double focalLength;
+
+        double fx, fy, cx, cy;
+        // k1, k2, p1, p2, k3
+        double k[5];
+
+        // undistortPoints' default five fixed-point iterations, inline so it's free of allocations.
+        void undistort(const std::vector<cv::Point2f>& distorted, std::vector<cv::Point2f>& normalized) const;
+        bool solveSquare(const cv::Point2f* points, Pose& pose, double& error) const;
+};
+
+#endif //POSESOLVER_H
@@ -0,0 +1,380 @@
+#include "SceneGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+using namespace std;
+using namespace cv;
+
+static const int texturePixelsPerModule[] = {2, 4, 8, 16, 32};
+static const int noiseFrames = 4;
+static const int samplesPerEdge = 8;
+
+SceneConfig::SceneConfig() {
+    this->width = 1280;
+    this->height = 800;
+    this->cameraMatrix = Matx33d(900, 0, 640, 0, 900, 400, 0, 0, 1);
+    this->distortionCoefficients = Matx<double, 5, 1>::zeros();
+
+    this->tagSizeMeters = 0.1651;
+    this->quietModules = 1;
+
+    this->tagCount = 4;
+    this->maxTagId = 16;
+    this->minDistance = 1;
+    this->maxDistance = 5;
+    this->maxTiltDegrees = 45;
+    this->maxRollDegrees = 10;
+
+    this->background = 100;
+    this->blurSigma = 0.8;
+    this->noiseSigma = 2;
+    this->color = false;
+
+    this->seed = 8230;
+}
+
+SceneTag::SceneTag() {
+    this->id = 0;
+}
+
+SceneGenerator::SceneGenerator(const SceneConfig& config):
+random(config.seed) {
+    this->config = config;
+
+    dictionary = aruco::getPredefinedDictionary(aruco::DICT_APRILTAG_36h11);
+
+    // The tag size is the outer edge of the black border, which is one module wide around the data bits.
+    int tagModules = dictionary.markerSize + 2;
+    cardModules = tagModules + 2 * config.quietModules;
+    tagHalf = config.tagSizeMeters / 2;
+    cardHalf = tagHalf * cardModules / tagModules;
+
+    padding = 2 + static_cast<int>(ceil(3 * config.blurSigma));
+
+    Point3d card[4] = {{-cardHalf, cardHalf, 0}, {cardHalf, cardHalf, 0}, {cardHalf, -cardHalf, 0},
+        {-cardHalf, -cardHalf, 0}};
+    for (int a = 0; a < 4; a++) {
+        for (int b = 0; b < samplesPerEdge; b++) {
+            double t = static_cast<double>(b) / samplesPerEdge;
+            edgeSamples.push_back(card[a] * (1 - t) + card[(a + 1) % 4] * t);
+        }
+    }
+
+    for (int id = 1; id <= config.maxTagId; id++) {
+        ids.push_back(id);
+    }
+
+    distorted = false;
+    for (int a = 0; a < 5; a++) {
+        distorted = distorted || config.distortionCoefficients(a) != 0;
+    }
+
+    if (distorted) {
+        // For every distorted output pixel, where it lands in an ideal pinhole image. Barrel distortion pulls the
+        // frame's edges in from outside the pinhole frame, so the canvas extends past it.
+        vector<Point2f> pixels;
+        pixels.reserve(static_cast<size_t>(config.width) * config.height);
+        for (int y = 0; y < config.height; y++) {
+            for (int x = 0; x < config.width; x++) {
+                pixels.emplace_back(static_cast<float>(x), static_cast<float>(y));
+            }
+        }
+
+        vector<Point2f> pinhole;
+        undistortPoints(pixels, pinhole, config.cameraMatrix, config.distortionCoefficients, noArray(),
+            config.cameraMatrix, TermCriteria(TermCriteria::COUNT, 20, 0));
+
+        float minX = numeric_limits<float>::max(), minY = numeric_limits<float>::max();
+        float maxX = numeric_limits<float>::lowest(), maxY = numeric_limits<float>::lowest();
+        for (Point2f& point : pinhole) {
+            point.x = clamp(point.x, -static_cast<float>(config.width), 2.f * config.width);
+            point.y = clamp(point.y, -static_cast<float>(config.height), 2.f * config.height);
+
+            minX = min(minX, point.x);
+            minY = min(minY, point.y);
+            maxX = max(maxX, point.x);
+            maxY = max(maxY, point.y);
+        }
+
+        canvasOrigin = Point(static_cast<int>(floor(minX)) - 2, static_cast<int>(floor(minY)) - 2);
+        int canvasWidth = static_cast<int>(ceil(maxX)) - canvasOrigin.x + 3;
+        int canvasHeight = static_cast<int>(ceil(maxY)) - canvasOrigin.y + 3;
+        canvas = Mat(canvasHeight, canvasWidth, CV_8UC1, Scalar::all(config.background));
+
+        Mat map(config.height, config.width, CV_32FC2);
+        for (int y = 0; y < config.height; y++) {
+            for (int x = 0; x < config.width; x++) {
+                Point2f point = pinhole[static_cast<size_t>(y) * config.width + x];
+                map.at<Vec2f>(y, x) = Vec2f(point.x - canvasOrigin.x, point.y - canvasOrigin.y);
+            }
+        }
+
+        convertMaps(map, noArray(), distortionMap1, distortionMap2, CV_16SC2);
+    }
+
+    if (config.noiseSigma > 0) {
+        // Split signed noise into two saturating 8-bit passes so applying it is two vectorized adds.
+        for (int a = 0; a < noiseFrames; a++) {
+            Mat noise(config.height, config.width, CV_32F);
+            random.fill(noise, RNG::NORMAL, Scalar::all(0), Scalar::all(config.noiseSigma));
+
+            Mat above = max(noise, 0.0);
+            Mat below = max(Mat(-noise), 0.0);
+
+            noiseAbove.emplace_back();
+            noiseBelow.emplace_back();
+            above.convertTo(noiseAbove.back(), CV_8U);
+            below.convertTo(noiseBelow.back(), CV_8U);
+        }
+    }
+    noiseIndex = 0;
+}
+
+const Mat& SceneGenerator::texture(int id, double modulePixels) {
+    vector<Mat>& levels = textures[id];
+
+    if (levels.empty()) {
+        for (int pixelsPerModule : texturePixelsPerModule) {
+            Mat marker;
+            aruco::generateImageMarker(dictionary, id, (dictionary.markerSize + 2) * pixelsPerModule, marker, 1);
+
+            int quietPixels = config.quietModules * pixelsPerModule;
+            levels.emplace_back();
+            copyMakeBorder(marker, levels.back(), quietPixels, quietPixels, quietPixels, quietPixels, BORDER_CONSTANT,
+                Scalar::all(255));
+        }
+    }
+
+    // The smallest level that still has a texel per output pixel, so bilinear sampling neither aliases nor smears.
+    for (int a = 0; a < levels.size(); a++) {
+        if (texturePixelsPerModule[a] >= modulePixels) {
+            return levels[a];
+        }
+    }
+    return levels.back();
+}
+
+Rect SceneGenerator::frameBounds(const Matx33d& rotation, const Matx31d& translation) {
+    Matx31d rvec;
+    Rodrigues(rotation, rvec);
+
+    // Distortion bows the card's edges, so bound samples along them rather than just the corners.
+    projectPoints(edgeSamples, rvec, translation, config.cameraMatrix, config.distortionCoefficients,
+        projectedSamples);
+
+    float minX = numeric_limits<float>::max(), minY = numeric_limits<float>::max();
+    float maxX = numeric_limits<float>::lowest(), maxY = numeric_limits<float>::lowest();
+    for (const Point2f& point : projectedSamples) {
+        minX = min(minX, point.x);
+        minY = min(minY, point.y);
+        maxX = max(maxX, point.x);
+        maxY = max(maxY, point.y);
+    }
+
+    return Rect(Point(static_cast<int>(floor(minX)) - 1, static_cast<int>(floor(minY)) - 1),
+        Point(static_cast<int>(ceil(maxX)) + 2, static_cast<int>(ceil(maxY)) + 2));
+}
+
+void SceneGenerator::render(vector<SceneTag>& tags, Mat& image) {
+    Mat& target = config.color ? gray : image;
+    target.create(config.height, config.width, CV_8UC1);
+    target.setTo(Scalar::all(config.background));
+
+    Mat& drawTarget = distorted ? canvas : target;
+    Point origin = distorted ? canvasOrigin : Point(0, 0);
+    Rect frame(0, 0, config.width, config.height);
+
+    canvasRegions.clear();
+    frameRegions.clear();
+
+    double fx = config.cameraMatrix(0, 0), fy = config.cameraMatrix(1, 1);
+    double cx = config.cameraMatrix(0, 2), cy = config.cameraMatrix(1, 2);
+
+    for (SceneTag& tag : tags) {
+        // Tag-in-camera from the camera-in-tag ground truth.
+        Matx33d rotation = tag.pose.rmat.t();
+        Matx31d translation = -(rotation * tag.pose.tvec);
+
+        Point3d tagCorners[4] = {{-tagHalf, tagHalf, 0}, {tagHalf, tagHalf, 0}, {tagHalf, -tagHalf, 0},
+            {-tagHalf, -tagHalf, 0}};
+
+        bool visible = true;
+        Point2f card[4];
+        double longestEdge = 0;
+
+        for (int a = 0; a < 4; a++) {
+            Point3d corner = tagCorners[a] * (cardHalf / tagHalf);
+            Matx31d camera = rotation * Matx31d(corner.x, corner.y, 0) + translation;
+            if (camera(2) < 1e-3) {
+                visible = false;
+                break;
+            }
+
+            card[a] = Point2f(static_cast<float>(fx * camera(0) / camera(2) + cx - origin.x),
+                static_cast<float>(fy * camera(1) / camera(2) + cy - origin.y));
+        }
+
+        if (!visible) {
+            continue;
+        }
+
+        for (int a = 0; a < 4; a++) {
+            Matx31d camera = rotation * Matx31d(tagCorners[a].x, tagCorners[a].y, 0) + translation;
+            double x = camera(0) / camera(2), y = camera(1) / camera(2);
+
+            // Same Brown-Conrady model as projectPoints, written out to avoid per-tag allocations.
+            double k1 = config.distortionCoefficients(0), k2 = config.distortionCoefficients(1);
+            double p1 = config.distortionCoefficients(2), p2 = config.distortionCoefficients(3);
+            double k3 = config.distortionCoefficients(4);
+            double r2 = x * x + y * y;
+            double radial = 1 + r2 * (k1 + r2 * (k2 + r2 * k3));
+            double xd = x * radial + 2 * p1 * x * y + p2 * (r2 + 2 * x * x);
+            double yd = y * radial + p1 * (r2 + 2 * y * y) + 2 * p2 * x * y;
+
+            tag.corners[a] = Point2f(static_cast<float>(fx * xd + cx), static_cast<float>(fy * yd + cy));
+        }
+
+        float minX = card[0].x, minY = card[0].y, maxX = card[0].x, maxY = card[0].y;
+        for (int a = 0; a < 4; a++) {
+            minX = min(minX, card[a].x);
+            minY = min(minY, card[a].y);
+            maxX = max(maxX, card[a].x);
+            maxY = max(maxY, card[a].y);
+            longestEdge = max(longestEdge, static_cast<double>(norm(card[(a + 1) % 4] - card[a])));
+        }
+
+        Rect bounds = Rect(Point(static_cast<int>(floor(minX)) - 1, static_cast<int>(floor(minY)) - 1),
+            Point(static_cast<int>(ceil(maxX)) + 2, static_cast<int>(ceil(maxY)) + 2)) &
+            Rect(0, 0, drawTarget.cols, drawTarget.rows);
+        if (bounds.empty()) {
+            continue;
+        }
+
+        const Mat& cardTexture = texture(tag.id, longestEdge / cardModules);
+        float right = static_cast<float>(cardTexture.cols) - 0.5f;
+        float bottom = static_cast<float>(cardTexture.rows) - 0.5f;
+        Point2f textureCorners[4] = {{-0.5f, -0.5f}, {right, -0.5f}, {right, bottom}, {-0.5f, bottom}};
+
+        Matx33d homography = Matx33d(1, 0, -bounds.x, 0, 1, -bounds.y, 0, 0, 1) *
+            Matx33d(getPerspectiveTransform(textureCorners, card));
+
+        Mat region = drawTarget(bounds);
+        warpPerspective(cardTexture, region, homography, bounds.size(), INTER_LINEAR, BORDER_TRANSPARENT);
+
+        canvasRegions.push_back(bounds);
+        frameRegions.push_back(distorted ? frameBounds(rotation, translation) & frame : bounds);
+    }
+
+    if (distorted) {
+        // Only after every tag is in the canvas, so a region that overlaps another tag can't paint over it.
+        for (const Rect& region : frameRegions) {
+            if (!region.empty()) {
+                Mat output = target(region);
+                remap(canvas, output, distortionMap1(region), distortionMap2(region), INTER_LINEAR, BORDER_CONSTANT,
+                    Scalar::all(config.background));
+            }
+        }
+
+        for (const Rect& region : canvasRegions) {
+            canvas(region).setTo(Scalar::all(config.background));
+        }
+    }
+
+    if (config.blurSigma > 0) {
+        // The background is flat, so blurring only around the tags gives the same frame as blurring all of it.
+        for (const Rect& region : frameRegions) {
+            Rect padded = Rect(region.x - padding, region.y - padding, region.width + 2 * padding,
+                region.height + 2 * padding) & frame;
+            if (!padded.empty()) {
+                Mat blurred = target(padded);
+                GaussianBlur(blurred, blurred, Size(0, 0), config.blurSigma);
+            }
+        }
+    }
+
+    if (config.noiseSigma > 0) {
+        add(target, noiseAbove[noiseIndex], target);
+        subtract(target, noiseBelow[noiseIndex], target);
+        noiseIndex = (noiseIndex + 1) % noiseFrames;
+    }
+
+    if (config.color) {
+        cvtColor(gray, image, COLOR_GRAY2BGR);
+    }
+}
+
+void SceneGenerator::generate(vector<SceneTag>& tags, Mat& image) {
+    tags.clear();
+
+    for (int a = static_cast<int>(ids.size()) - 1; a > 0; a--) {
+        swap(ids[a], ids[random.uniform(0, a + 1)]);
+    }
+
+    // Facing the camera: tag +x along image +x, tag +y up the image, tag +z back toward the lens.
+    Matx33d facing(1, 0, 0, 0, -1, 0, 0, 0, -1);
+    Rect frame(0, 0, config.width, config.height);
+
+    placements.clear();
+
+    int tagCount = min(config.tagCount, static_cast<int>(ids.size()));
+    for (int a = 0; a < tagCount; a++) {
+        for (int attempt = 0; attempt < 32; attempt++) {
+            double distance = random.uniform(config.minDistance, config.maxDistance);
+            double u = random.uniform(0.0, static_cast<double>(config.width));
+            double v = random.uniform(0.0, static_cast<double>(config.height));
+
+            Vec3d direction((u - config.cameraMatrix(0, 2)) / config.cameraMatrix(0, 0),
+                (v - config.cameraMatrix(1, 2)) / config.cameraMatrix(1, 1), 1);
+            Vec3d center = direction * (distance / norm(direction));
+
+            double tilt = random.uniform(0.0, config.maxTiltDegrees) * CV_PI / 180;
+            double tiltAxis = random.uniform(0.0, 2 * CV_PI);
+            double roll = random.uniform(-config.maxRollDegrees, config.maxRollDegrees) * CV_PI / 180;
+
+            Matx33d tiltRotation, rollRotation;
+            Rodrigues(Vec3d(cos(tiltAxis), sin(tiltAxis), 0) * tilt, tiltRotation);
+            Rodrigues(Vec3d(0, 0, roll), rollRotation);
+
+            Matx33d rotation = facing * tiltRotation * rollRotation;
+            Matx31d translation(center(0), center(1), center(2));
+
+            bool inFront = true;
+            for (const Point3d& sample : edgeSamples) {
+                Matx31d camera = rotation * Matx31d(sample.x, sample.y, sample.z) + translation;
+                inFront = inFront && camera(2) > 0.05;
+            }
+            if (!inFront) {
+                continue;
+            }
+
+            Rect bounds = frameBounds(rotation, translation);
+            if ((bounds & frame) != bounds) {
+                continue;
+            }
+
+            Rect padded(bounds.x - padding, bounds.y - padding, bounds.width + 2 * padding,
+                bounds.height + 2 * padding);
+            if (any_of(placements.begin(), placements.end(), [&padded](const Rect& other) {
+                return !(padded & other).empty();
+            })) {
+                continue;
+            }
+
+            SceneTag tag;
+            tag.id = ids[a];
+            tag.pose.rmat = rotation.t();
+            tag.pose.tvec = -(tag.pose.rmat * translation);
+
+            tags.push_back(tag);
+            placements.push_back(padded);
+            break;
+        }
+    }
+
+    render(tags, image);
+}
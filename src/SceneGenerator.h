@@ -0,0 +1,106 @@
+#ifndef SCENEGENERATOR_H
+#define SCENEGENERATOR_H
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/matx.hpp>
+#include <opencv2/core/types.hpp>
+#include <opencv2/objdetect/aruco_dictionary.hpp>
+
+#include "Utils.h"
+
+struct SceneConfig {
+    int width;
+    int height;
+    cv::Matx33d cameraMatrix;
+    cv::Matx<double, 5, 1> distortionCoefficients;
+
+    double tagSizeMeters;
+    // White margin around each tag, in tag modules.
+    int quietModules;
+
+    // Random scenes place tagCount tags with distinct ids in [1, maxTagId], minDistance to maxDistance meters away,
+    // tilted up to maxTiltDegrees away from facing the camera and rolled up to maxRollDegrees.
+    int tagCount;
+    int maxTagId;
+    double minDistance;
+    double maxDistance;
+    double maxTiltDegrees;
+    double maxRollDegrees;
+
+    int background;
+    double blurSigma;
+    double noiseSigma;
+    bool color;
+
+    uint64_t seed;
+
+    SceneConfig();
+};
+
+// Ground truth for one rendered tag: the camera-in-tag pose in the same convention PoseSolver reports, and the
+// distorted pixel corners in the order the detector returns them.
+struct SceneTag {
+    int id;
+    Pose pose;
+    std::array<cv::Point2f, 4> corners;
+
+    SceneTag();
+};
+
+// Renders 36h11 tags with known poses through the camera's intrinsics and distortion. Per-frame work scales with
+// the area the tags cover rather than the frame: tags are warped into a pinhole canvas and pulled through a
+// precomputed distortion map only around each tag, blur is applied only around the tags, and noise comes from a
+// bank generated up front. Deterministic for a given seed.
+class SceneGenerator {
+    public:
+        explicit SceneGenerator(const SceneConfig& config);
+
+        // Renders tags at their ids and poses, filling in their corners.
+        void render(std::vector<SceneTag>& tags, cv::Mat& image);
+
+        // Places config.tagCount non-overlapping tags fully inside the frame at random poses and renders them. Fewer
+        // tags are placed when the frame is too crowded to fit them all.
+        void generate(std::vector<SceneTag>& tags, cv::Mat& image);
+    private:
+        SceneConfig config;
+        cv::aruco::Dictionary dictionary;
+        cv::RNG random;
+
+        double tagHalf;
+        double cardHalf;
+        int cardModules;
+        int padding;
+
+        bool distorted;
+        cv::Mat distortionMap1;
+        cv::Mat distortionMap2;
+        cv::Mat canvas;
+        cv::Point canvasOrigin;
+
+        cv::Mat gray;
+
+        std::vector<cv::Mat> noiseAbove;
+        std::vector<cv::Mat> noiseBelow;
+        int noiseIndex;
+
+        std::map<int, std::vector<cv::Mat>> textures;
+
+        std::vector<int> ids;
+        std::vector<cv::Point3d> edgeSamples;
+        std::vector<cv::Point2f> projectedSamples;
+        std::vector<cv::Rect> canvasRegions;
+        std::vector<cv::Rect> frameRegions;
+        std::vector<cv::Rect> placements;
+
+        const cv::Mat& texture(int id, double modulePixels);
+
+        cv::Rect frameBounds(const cv::Matx33d& rotation, const cv::Matx31d& translation);
+};
+
+#endif //SCENEGENERATOR_H
@@ -0,0 +1,252 @@
+#include "Setup.h"
+
+#include <cmath>
+
+#include "Log.h"
+
+using namespace cv;
+using namespace std;
+
+CameraConfig setupCameraConfig(nlohmann::json camera) {
+    vector<vector<double>> cameraMatrix(3, vector<double>(3, 0));
+
+    cameraMatrix[0][0] = camera["matrix"]["fx"];
+    cameraMatrix[0][2] = camera["matrix"]["cx"];
+    cameraMatrix[1][1] = camera["matrix"]["fy"];
+    cameraMatrix[1][2] = camera["matrix"]["cy"];
+    cameraMatrix[2][2] = 1;
+
+    vector<double> distCoeffs(5);
+    distCoeffs[0] = camera["distCoeffs"]["k1"];
+    distCoeffs[1] = camera["distCoeffs"]["k2"];
+    distCoeffs[2] = camera["distCoeffs"]["p1"];
+    distCoeffs[3] = camera["distCoeffs"]["p2"];
+    distCoeffs[4] = camera["distCoeffs"]["k3"];
+
+    SourceConfig sourceConfig = SourceConfig();
+    sourceConfig.path = camera["id"];
+    sourceConfig.width = camera["frameWidth"];
+    sourceConfig.height = camera["frameHeight"];
+    sourceConfig.fps = camera["fps"];
+    sourceConfig.type = camera.value("backend", sourceConfig.type);
+    sourceConfig.pixelFormat = camera.value("pixelFormat", sourceConfig.pixelFormat);
+    sourceConfig.color = camera.value("color", sourceConfig.color);
+    sourceConfig.maxFrameAgeMicros = llround(camera.value("maxFrameAgeMilliseconds", 0.0) * 1000);
+
+    if (camera.contains("replay")) {
+        auto replay = camera["replay"];
+        sourceConfig.type = replay["type"];
+        sourceConfig.path = replay.value("path", sourceConfig.path);
+        sourceConfig.realtime = replay.value("realtime", true);
+        sourceConfig.loop = replay.value("loop", false);
+        sourceConfig.fps = replay.value("fps", sourceConfig.fps);
+
+        if (sourceConfig.type == "synthetic") {
+            sourceConfig.scene = setupSceneConfig(replay.value("scene", nlohmann::json::object()), cameraMatrix,
+                distCoeffs, sourceConfig.width, sourceConfig.height);
+        }
+    }
+
+    return CameraConfig{cameraMatrix, distCoeffs, sourceConfig};
+}
+
+SourceConfig setupBenchSource(nlohmann::json benchConfig, SourceConfig sourceConfig,
+    const vector<vector<double>> &cameraMatrix, const vector<double> &distCoeffs) {
+    if (benchConfig.contains("source")) {
+        auto source = benchConfig["source"];
+        sourceConfig.type = source["type"];
+        sourceConfig.path = source.value("path", sourceConfig.path);
+        sourceConfig.fps = source.value("fps", sourceConfig.fps);
+
+        if (sourceConfig.type == "synthetic") {
+            sourceConfig.scene = setupSceneConfig(source.value("scene", nlohmann::json::object()), cameraMatrix,
+                distCoeffs, sourceConfig.width, sourceConfig.height);
+        }
+    }
+    sourceConfig.realtime = false;
+    sourceConfig.loop = false;
+
+    return sourceConfig;
+}
+
+SceneConfig setupSceneConfig(nlohmann::json sceneConfig, const vector<vector<double>> &cameraMatrix,
+    const vector<double> &distCoeffs, int width, int height) {
+    SceneConfig scene = SceneConfig();
+
+    scene.width = sceneConfig.value("width", width);
+    scene.height = sceneConfig.value("height", height);
+
+    for (int a = 0; a < 3; a++) {
+        for (int b = 0; b < 3; b++) {
+            scene.cameraMatrix(a, b) = cameraMatrix[a][b];
+        }
+    }
+
+    for (int a = 0; a < 5; a++) {
+        scene.distortionCoefficients(a) = distCoeffs[a];
+    }
+
+    scene.tagSizeMeters = sceneConfig.value("tagSizeMeters", scene.tagSizeMeters);
+    scene.quietModules = sceneConfig.value("quietModules", scene.quietModules);
+
+    scene.tagCount = sceneConfig.value("tagCount", scene.tagCount);
+    scene.maxTagId = sceneConfig.value("maxTagId", scene.maxTagId);
+    scene.minDistance = sceneConfig.value("minDistance", scene.minDistance);
+    scene.maxDistance = sceneConfig.value("maxDistance", scene.maxDistance);
+    scene.maxTiltDegrees = sceneConfig.value("maxTiltDegrees", scene.maxTiltDegrees);
+    scene.maxRollDegrees = sceneConfig.value("maxRollDegrees", scene.maxRollDegrees);
+
+    scene.background = sceneConfig.value("background", scene.background);
+    scene.blurSigma = sceneConfig.value("blurSigma", scene.blurSigma);
+    scene.noiseSigma = sceneConfig.value("noiseSigma", scene.noiseSigma);
+
+    scene.seed = sceneConfig.value("seed", scene.seed);
+
+    return scene;
+}
+
+aruco::DetectorParameters setupDetectorParameters(nlohmann::json detectorConfig) {
+    aruco::DetectorParameters detectParams = aruco::DetectorParameters();
+
+    detectParams.adaptiveThreshWinSizeMin = detectorConfig["adaptiveThreshWinMin"];
+    detectParams.adaptiveThreshWinSizeMax = detectorConfig["adaptiveThreshWinMax"];
+    detectParams.adaptiveThreshWinSizeStep = detectorConfig["adaptiveThreshWinStep"];
+
+    detectParams.minMarkerPerimeterRate = detectorConfig["minMarkerPerimiterRate"];
+    detectParams.maxMarkerPerimeterRate = detectorConfig["maxMarkerPerimiterRate"];
+
+    detectParams.minMarkerDistanceRate = detectorConfig["minMarkerDistanceRate"];
+
+    detectParams.minDistanceToBorder = detectorConfig["minDistanceToBorder"];
+
+    detectParams.perspectiveRemovePixelPerCell = detectorConfig["perspectiveRemovePixelPerCell"];
+    detectParams.perspectiveRemoveIgnoredMarginPerCell = detectorConfig["perspectiveRemoveIgnoredMarginPerCell"];
+
+    detectParams.maxErroneousBitsInBorderRate = detectorConfig["maxErroneousBitsInBorderRate"];
+    detectParams.errorCorrectionRate = detectorConfig["errorCorrectionRate"];
+
+    detectParams.cornerRefinementMethod = aruco::CORNER_REFINE_APRILTAG;
+    detectParams.relativeCornerRefinmentWinSize = detectorConfig["relativeCornerRefinmentWinSize"];
+    detectParams.cornerRefinementMaxIterations = detectorConfig["cornerRefinementMaxIterations"];
+    detectParams.cornerRefinementMinAccuracy = detectorConfig["cornerRefinementMinAccuracy"];
+
+    detectParams.useAruco3Detection = true;
+
+    return detectParams;
+}
+
+TrackingParameters setupTrackingParameters(nlohmann::json detectorConfig) {
+    TrackingParameters trackingParams = TrackingParameters();
+
+    trackingParams.enabled = detectorConfig["trackingEnabled"];
+    trackingParams.fullSearchInterval = detectorConfig["trackingFullSearchInterval"];
+    trackingParams.roiPadding = detectorConfig["trackingRoiPadding"];
+    trackingParams.minRoiPaddingPixels = detectorConfig["trackingMinRoiPaddingPixels"];
+    trackingParams.timeoutMicros = detectorConfig["trackingTimeoutMilliseconds"].get<int64_t>() * 1000;
+
+    return trackingParams;
+}
+
+ThresholdParameters setupThresholdParameters(nlohmann::json detectorConfig) {
+    ThresholdParameters thresholdParams = ThresholdParameters();
+
+    // "opencv" thresholds inside ArucoDetector, "simd" uses ThresholdDetector.
+    thresholdParams.simd = detectorConfig["thresholdBackend"] == "simd";
+    thresholdParams.tiles = detectorConfig["detectionTiles"];
+    thresholdParams.tileOverlap = detectorConfig["detectionTileOverlap"];
+
+    if (thresholdParams.tiles > 1 && !thresholdParams.simd) {
+        LOG_WARNING("detectionTiles only applies to the simd threshold backend");
+    }
+
+    return thresholdParams;
+}
+
+AllocationParameters setupAllocationParameters(nlohmann::json threadConfig) {
+    AllocationParameters allocationParams = AllocationParameters();
+
+    allocationParams.totalThreads = threadConfig["totalThreads"];
+    allocationParams.minThreadsPerCamera = threadConfig["minThreadsPerCamera"];
+    allocationParams.intervalMicros = threadConfig["allocationIntervalMilliseconds"].get<int64_t>() * 1000;
+    allocationParams.smoothing = threadConfig["allocationSmoothing"];
+    allocationParams.explorationWeight = threadConfig["allocationExplorationWeight"];
+    allocationParams.frameRateHeadroom = threadConfig["allocationFrameRateHeadroom"];
+
+    return allocationParams;
+}
+
+static ThreadPlacement setupThreadPlacement(nlohmann::json threadConfig, const char* role) {
+    ThreadPlacement placement = ThreadPlacement();
+
+    auto roles = threadConfig.value("placement", nlohmann::json::object());
+    if (!roles.contains(role)) {
+        return placement;
+    }
+
+    auto placementConfig = roles[role];
+    placement.placed = true;
+
+    if (placementConfig.contains("cores")) {
+        auto cores = placementConfig["cores"];
+        placement.cores = cores.is_string() ? coreClass(cores.get<string>()) : cores.get<vector<int>>();
+    }
+    placement.pinEach = placementConfig.value("pinEach", placement.pinEach);
+
+    placement.fifo = placementConfig.value("policy", "other") == "fifo";
+    placement.priority = placementConfig.value("priority", placement.priority);
+    placement.nice = placementConfig.value("nice", placement.nice);
+
+    return placement;
+}
+
+ThreadPlacements setupThreadPlacements(nlohmann::json threadConfig) {
+    ThreadPlacements placements = ThreadPlacements();
+
+    placements.dispatcher = setupThreadPlacement(threadConfig, "dispatcher");
+    placements.capture = setupThreadPlacement(threadConfig, "capture");
+    placements.workers = setupThreadPlacement(threadConfig, "workers");
+    placements.publisher = setupThreadPlacement(threadConfig, "publisher");
+
+    return placements;
+}
+
+vector<FieldTag> setupFieldTags(nlohmann::json layoutConfig) {
+    vector<FieldTag> tags;
+
+    for (auto tag : layoutConfig["tags"]) {
+        auto translation = tag["pose"]["translation"];
+        auto quaternion = tag["pose"]["rotation"]["quaternion"];
+
+        FieldTag fieldTag = FieldTag();
+        fieldTag.id = tag["ID"];
+        fieldTag.translation = Vec3d(translation["x"].get<double>(), translation["y"].get<double>(),
+            translation["z"].get<double>());
+        fieldTag.rotation = Vec4d(quaternion["W"].get<double>(), quaternion["X"].get<double>(),
+            quaternion["Y"].get<double>(), quaternion["Z"].get<double>());
+
+        tags.push_back(fieldTag);
+    }
+
+    return tags;
+}
+
+FieldLayout setupFieldLayout(const DetectorConfig& detector) {
+    FieldLayout layout(detector.tagSizeMeters);
+
+    for (const FieldTag& tag : detector.fieldTags) {
+        layout.addTag(tag.id, tag.translation, tag.rotation);
+    }
+
+    return layout;
+}
+
+bool setupTrace(const TraceConfig& traceConfig) {
+    if (!traceConfig.enabled) {
+        return false;
+    }
+
+    Trace::enable(traceConfig.eventsPerThread);
+    Trace::dumpOnSignal(traceConfig.path);
+
+    return true;
+}
@@ -0,0 +1,54 @@
+#ifndef SETUP_H
+#define SETUP_H
+
+#include <vector>
+
+#include <opencv2/objdetect/aruco_detector.hpp>
+
+#include "../include/json.hpp"
+
+#include "AllocationController.h"
+#include "Config.h"
+#include "FieldLayout.h"
+#include "FrameSource.h"
+#include "SceneGenerator.h"
+#include "TagTracker.h"
+#include "ThresholdDetector.h"
+#include "ThreadPlacement.h"
+#include "Trace.h"
+
+// Config readers shared by fisheye and the benchmarks. These expect JSON loadConfig has already checked.
+CameraConfig setupCameraConfig(nlohmann::json camera);
+
+// Where a benchmark's frames come from: the given camera's source, or bench.json's "source" when it has one, always
+// read as fast as possible.
+SourceConfig setupBenchSource(nlohmann::json benchConfig, SourceConfig sourceConfig,
+    const std::vector<std::vector<double>> &cameraMatrix, const std::vector<double> &distCoeffs);
+
+// Unset scene fields keep SceneConfig's defaults; the frame size defaults to the camera's.
+SceneConfig setupSceneConfig(nlohmann::json sceneConfig, const std::vector<std::vector<double>> &cameraMatrix,
+    const std::vector<double> &distCoeffs, int width, int height);
+
+cv::aruco::DetectorParameters setupDetectorParameters(nlohmann::json detectorConfig);
+
+TrackingParameters setupTrackingParameters(nlohmann::json detectorConfig);
+
+ThresholdParameters setupThresholdParameters(nlohmann::json detectorConfig);
+
+// The tags of a WPILib AprilTagFieldLayout file.
+std::vector<FieldTag> setupFieldTags(nlohmann::json layoutConfig);
+
+// Empty when detector.json names no field layout.
+FieldLayout setupFieldLayout(const DetectorConfig& detector);
+
+AllocationParameters setupAllocationParameters(nlohmann::json threadConfig);
+
+// threading.json's "placement" object. "cores" is a core class name or a list of CPU numbers; a missing entry puts
+// that kind of thread back on the cores and scheduler the process started with.
+ThreadPlacements setupThreadPlacements(nlohmann::json threadConfig);
+
+// Turns tracing on when trace.json enables it. Call in main before any other thread is started, so every thread
+// inherits the blocked dump signals.
+bool setupTrace(const TraceConfig& traceConfig);
+
+#endif //SETUP_H
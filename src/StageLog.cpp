@@ -0,0 +1,76 @@
+#include "StageLog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+
+#include <ntcore/networktables/NetworkTableInstance.h>
+
+using namespace std;
+
+StageMark::StageMark() {
+    this->wall = 0;
+    this->cpu = 0;
+}
+
+StageMark StageMark::now() {
+    StageMark mark;
+
+    timespec cpuTime;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuTime);
+
+    mark.wall = nt::Now();
+    mark.cpu = static_cast<int64_t>(cpuTime.tv_sec) * 1000000 + cpuTime.tv_nsec / 1000;
+
+    return mark;
+}
+
+StageTimings::StageTimings() {
+    this->sequence = 0;
+    this->captured = 0;
+    this->tagCount = 0;
+    this->observationCount = 0;
+}
+
+StageLog::StageLog(int capacity, int maxTagsPerFrame):
+entries(capacity), tagObservations(static_cast<size_t>(capacity) * maxTagsPerFrame) {
+    this->maxTagsPerFrame = maxTagsPerFrame;
+    next.store(0);
+}
+
+void StageLog::record(StageTimings timings, const FrameScratch& scratch) {
+    int index = next.fetch_add(1, memory_order_relaxed);
+    if (index >= entries.size()) {
+        return;
+    }
+
+    TagObservation* observations = &tagObservations[static_cast<size_t>(index) * maxTagsPerFrame];
+    timings.observationCount = 0;
+
+    for (int i = 0; i < scratch.tagCount && timings.observationCount < maxTagsPerFrame; i++) {
+        if (!isfinite(scratch.reprojectionErrors[i])) {
+            continue;
+        }
+
+        TagObservation& observation = observations[timings.observationCount];
+        observation.id = scratch.apriltags[i].id;
+        observation.corners = scratch.apriltags[i].corners;
+        observation.pose = scratch.poses[i];
+
+        timings.observationCount += 1;
+    }
+
+    entries[index] = timings;
+}
+
+int StageLog::size() const {
+    return min(next.load(), static_cast<int>(entries.size()));
+}
+
+const StageTimings& StageLog::operator[](int index) const {
+    return entries[index];
+}
+
+const TagObservation* StageLog::observations(int index) const {
+    return &tagObservations[static_cast<size_t>(index) * maxTagsPerFrame];
+}
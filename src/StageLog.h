@@ -0,0 +1,68 @@
+#ifndef STAGELOG_H
+#define STAGELOG_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core/types.hpp>
+
+#include "Utils.h"
+
+// Wall time on the NetworkTables clock and this thread's CPU time, both in microseconds.
+struct StageMark {
+    int64_t wall;
+    int64_t cpu;
+
+    StageMark();
+
+    static StageMark now();
+};
+
+// A tag solved in a logged frame.
+struct TagObservation {
+    int id;
+    std::array<cv::Point2f, 4> corners;
+    Pose pose;
+};
+
+// When each stage of one runIteration finished. captured is the frame's capture timestamp and sequence its number in
+// the camera's frame slot.
+struct StageTimings {
+    uint64_t sequence;
+    int64_t captured;
+    StageMark started;
+    StageMark claimed;
+    StageMark detected;
+    StageMark solved;
+    StageMark published;
+    int tagCount;
+    // Of them, those with a solved pose, kept by the log.
+    int observationCount;
+
+    StageTimings();
+};
+
+// Fixed capacity record of per-frame stage timings, filled lock-free by the workers. Entries past capacity are dropped.
+// Each entry also keeps up to maxTagsPerFrame of the frame's solved tags, for checks against ground truth.
+class StageLog {
+    public:
+        StageLog(int capacity, int maxTagsPerFrame);
+
+        // Copies the solved tags out of scratch.
+        void record(StageTimings timings, const FrameScratch& scratch);
+
+        // Only safe to read once every worker that records into the log has finished.
+        int size() const;
+        const StageTimings& operator[](int index) const;
+        // The observationCount solved tags of entry index.
+        const TagObservation* observations(int index) const;
+    private:
+        std::vector<StageTimings> entries;
+        std::vector<TagObservation> tagObservations;
+        int maxTagsPerFrame;
+        std::atomic<int> next;
+};
+
+#endif //STAGELOG_H
@@ -0,0 +1,141 @@
+#include "TagTracker.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+TrackingParameters::TrackingParameters() {
+    this->enabled = false;
+    this->fullSearchInterval = 1;
+    this->roiPadding = 0;
+    this->minRoiPaddingPixels = 0;
+    this->timeoutMicros = 0;
+}
+
+static Point2f center(const array<Point2f, 4>& corners) {
+    return (corners[0] + corners[1] + corners[2] + corners[3]) * 0.25f;
+}
+
+TagTracker::TagTracker(const TrackingParameters& params, int maxTags) {
+    this->params = params;
+
+    tracks.reserve(maxTags);
+    previousTracks.reserve(maxTags);
+
+    framesSinceFullSearch = 0;
+    lost = true;
+}
+
+bool TagTracker::predict(int64_t timestamp, Size imageSize, vector<Rect>& rois) {
+    rois.clear();
+
+    lock_guard<mutex> lock(trackerMutex);
+
+    if (!params.enabled || lost || framesSinceFullSearch >= params.fullSearchInterval) {
+        return false;
+    }
+
+    Rect image(0, 0, imageSize.width, imageSize.height);
+
+    for (const Track& track : tracks) {
+        if (timestamp - track.timestamp > params.timeoutMicros) {
+            lost = true;
+            rois.clear();
+            return false;
+        }
+
+        float dt = static_cast<float>(max<int64_t>(timestamp - track.timestamp, 0)) / 1e6f;
+        Point2f shift = track.velocity * dt;
+
+        float minX = track.corners[0].x, maxX = minX, minY = track.corners[0].y, maxY = minY;
+        for (const Point2f& corner : track.corners) {
+            minX = min({minX, corner.x, corner.x + shift.x});
+            maxX = max({maxX, corner.x, corner.x + shift.x});
+            minY = min({minY, corner.y, corner.y + shift.y});
+            maxY = max({maxY, corner.y, corner.y + shift.y});
+        }
+
+        int padding = max(params.minRoiPaddingPixels,
+            static_cast<int>(params.roiPadding * max(maxX - minX, maxY - minY)));
+
+        Rect roi(static_cast<int>(minX) - padding, static_cast<int>(minY) - padding,
+            static_cast<int>(maxX - minX) + 2 * padding, static_cast<int>(maxY - minY) + 2 * padding);
+        roi &= image;
+
+        if (!roi.empty()) {
+            rois.push_back(roi);
+        }
+    }
+
+    // Merge overlapping regions so a tag is never searched for (or reported) twice.
+    for (int a = 0; a < rois.size(); a++) {
+        for (int b = a + 1; b < rois.size(); b++) {
+            if ((rois[a] & rois[b]).area() > 0) {
+                rois[a] |= rois[b];
+                rois.erase(rois.begin() + b);
+                b = a;
+            }
+        }
+    }
+
+    if (rois.empty()) {
+        return false;
+    }
+
+    framesSinceFullSearch += 1;
+    return true;
+}
+
+void TagTracker::update(const vector<Apriltag>& apriltags, int tagCount, int64_t timestamp, bool fullSearch) {
+    lock_guard<mutex> lock(trackerMutex);
+
+    swap(tracks, previousTracks);
+    tracks.clear();
+
+    for (int i = 0; i < tagCount; i++) {
+        const Apriltag& apriltag = apriltags[i];
+
+        auto previous = find_if(previousTracks.begin(), previousTracks.end(),
+            [&apriltag](const Track& track) { return track.id == apriltag.id; });
+
+        if (previous != previousTracks.end() && previous->timestamp >= timestamp) {
+            tracks.push_back(*previous);
+            continue;
+        }
+
+        Track track{apriltag.id, apriltag.corners, Point2f(0, 0), timestamp};
+
+        if (previous != previousTracks.end()) {
+            float dt = static_cast<float>(timestamp - previous->timestamp) / 1e6f;
+            track.velocity = (center(apriltag.corners) - center(previous->corners)) / dt;
+        }
+
+        tracks.push_back(track);
+    }
+
+    bool missedTrack = false;
+
+    for (const Track& previous : previousTracks) {
+        bool seen = any_of(tracks.begin(), tracks.end(),
+            [&previous](const Track& track) { return track.id == previous.id; });
+
+        if (seen) {
+            continue;
+        }
+
+        if (previous.timestamp > timestamp) {
+            // A newer frame already saw this tag, keep it.
+            tracks.push_back(previous);
+        } else if (!fullSearch) {
+            missedTrack = true;
+        }
+    }
+
+    if (fullSearch) {
+        framesSinceFullSearch = 0;
+        lost = tracks.empty();
+    } else if (missedTrack || tracks.empty()) {
+        lost = true;
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef TAGTRACKER_H
+#define TAGTRACKER_H
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/core/types.hpp>
+
+#include "Utils.h"
+
+struct TrackingParameters {
+    bool enabled;
+    int fullSearchInterval;
+    double roiPadding;
+    int minRoiPaddingPixels;
+    int64_t timeoutMicros;
+
+    TrackingParameters();
+};
+
+struct Track {
+    int id;
+    std::array<cv::Point2f, 4> corners;
+    cv::Point2f velocity;
+    int64_t timestamp;
+};
+
+// Remembers where each tag was last seen so detection can be limited to padded regions around its predicted position.
+// Shared by all of a camera's workers; frames may finish out of order, so older observations never overwrite newer ones.
+class TagTracker {
+    public:
+        TagTracker(const TrackingParameters& params, int maxTags);
+
+        // Fills rois with the predicted search regions, or returns false when this frame needs a full-frame search.
+        bool predict(int64_t timestamp, cv::Size imageSize, std::vector<cv::Rect>& rois);
+
+        void update(const std::vector<Apriltag>& apriltags, int tagCount, int64_t timestamp, bool fullSearch);
+    private:
+        TrackingParameters params;
+
+        std::vector<Track> tracks;
+        std::vector<Track> previousTracks;
+
+        int framesSinceFullSearch;
+        bool lost;
+
+        std::mutex trackerMutex;
+};
+
+#endif //TAGTRACKER_H
@@ -0,0 +1,165 @@
+#include "ThreadPlacement.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Log.h"
+
+using namespace std;
+
+// Where main was when the process started. Read during static initialization, on the main thread and before any
+// placement is applied.
+struct StartingPlacement {
+    cpu_set_t cores;
+    int policy;
+    sched_param parameters;
+    int nice;
+};
+
+static StartingPlacement readStartingPlacement() {
+    StartingPlacement placement;
+
+    CPU_ZERO(&placement.cores);
+    pthread_getaffinity_np(pthread_self(), sizeof(placement.cores), &placement.cores);
+    pthread_getschedparam(pthread_self(), &placement.policy, &placement.parameters);
+    placement.nice = getpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)));
+
+    return placement;
+}
+
+static const StartingPlacement startingPlacement = readStartingPlacement();
+
+// Puts an unplaced thread back where the process started, rather than leaving it where the placed thread that started
+// it was.
+static void restoreStartingPlacement(const char* role, int slot) {
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(startingPlacement.cores), &startingPlacement.cores);
+    if (error != 0) {
+        LOG_WARNING("Could not unpin %s thread %d: %s", role, slot, strerror(error));
+    }
+
+    int policy;
+    sched_param current;
+    pthread_getschedparam(pthread_self(), &policy, &current);
+
+    if (policy != startingPlacement.policy || current.sched_priority != startingPlacement.parameters.sched_priority) {
+        error = pthread_setschedparam(pthread_self(), startingPlacement.policy, &startingPlacement.parameters);
+        if (error != 0) {
+            LOG_WARNING("Could not restore %s thread %d's scheduler: %s", role, slot, strerror(error));
+        }
+    }
+
+    if (startingPlacement.policy == SCHED_FIFO || startingPlacement.policy == SCHED_RR) {
+        return;
+    }
+
+    id_t threadId = static_cast<id_t>(syscall(SYS_gettid));
+    if (getpriority(PRIO_PROCESS, threadId) != startingPlacement.nice &&
+        setpriority(PRIO_PROCESS, threadId, startingPlacement.nice) != 0) {
+        LOG_WARNING("Could not restore %s thread %d to nice %d: %s", role, slot, startingPlacement.nice,
+            strerror(errno));
+    }
+}
+
+ThreadPlacement::ThreadPlacement() {
+    this->placed = false;
+    this->pinEach = false;
+    this->fifo = false;
+    this->priority = 1;
+    this->nice = 0;
+}
+
+void ThreadPlacement::apply(const char* role, int slot) const {
+    if (!placed) {
+        restoreStartingPlacement(role, slot);
+        return;
+    }
+
+    // Everything is set, defaults included, so nothing carries over from the placement of the thread that started
+    // this one.
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (cores.empty()) {
+        for (int cpu = 0; cpu < static_cast<int>(thread::hardware_concurrency()); cpu++) {
+            CPU_SET(cpu, &set);
+        }
+    } else if (pinEach) {
+        CPU_SET(cores[slot % cores.size()], &set);
+    } else {
+        for (int core : cores) {
+            CPU_SET(core, &set);
+        }
+    }
+
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0) {
+        LOG_WARNING("Could not pin %s thread %d: %s", role, slot, strerror(error));
+    }
+
+    int policy;
+    sched_param current;
+    pthread_getschedparam(pthread_self(), &policy, &current);
+
+    if (fifo) {
+        sched_param parameters = {};
+        parameters.sched_priority = priority;
+
+        error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters);
+        if (error != 0) {
+            LOG_WARNING("Could not run %s thread %d as SCHED_FIFO %d: %s", role, slot, priority, strerror(error));
+        }
+        return;
+    }
+
+    if (policy != SCHED_OTHER) {
+        sched_param parameters = {};
+        pthread_setschedparam(pthread_self(), SCHED_OTHER, &parameters);
+    }
+
+    // On Linux a nice value belongs to the thread, addressed by its thread id.
+    id_t threadId = static_cast<id_t>(syscall(SYS_gettid));
+    if (getpriority(PRIO_PROCESS, threadId) != nice && setpriority(PRIO_PROCESS, threadId, nice) != 0) {
+        LOG_WARNING("Could not set %s thread %d to nice %d: %s", role, slot, nice, strerror(errno));
+    }
+}
+
+vector<int> coreClass(const string& name) {
+    int cpuCount = static_cast<int>(thread::hardware_concurrency());
+
+    vector<int> capacities;
+    for (int cpu = 0; cpu < cpuCount; cpu++) {
+        ifstream capacityFile("/sys/devices/system/cpu/cpu" + to_string(cpu) + "/cpu_capacity");
+        int capacity = 0;
+        capacityFile >> capacity;
+        capacities.push_back(capacityFile ? capacity : 0);
+    }
+
+    int biggest = capacities.empty() ? 0 : *max_element(capacities.begin(), capacities.end());
+
+    vector<int> cores;
+    for (int cpu = 0; cpu < cpuCount; cpu++) {
+        bool big = capacities[cpu] == biggest;
+        if (name == "all" || (name == "big" && big) || (name == "little" && !big)) {
+            cores.push_back(cpu);
+        }
+    }
+
+    if (name != "all" && name != "big" && name != "little") {
+        LOG_WARNING("Unknown core class %s", name.c_str());
+    } else if (cores.empty()) {
+        // Empty cores means any core, so say so rather than quietly run the threads everywhere.
+        LOG_WARNING("This CPU has no %s cores, as its cores all report the same capacity; threads placed on them will "
+            "run on any core", name.c_str());
+    }
+
+    return cores;
+}
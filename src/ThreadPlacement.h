@@ -0,0 +1,44 @@
+#ifndef THREADPLACEMENT_H
+#define THREADPLACEMENT_H
+
+#include <string>
+#include <vector>
+
+// Which cores a kind of thread may run on and how the kernel schedules it. Threads inherit both from the thread that
+// starts them.
+struct ThreadPlacement {
+    // False for a kind of thread the config doesn't place, which is put back on the cores and scheduler the process
+    // started with rather than left with those of a placed thread that started it.
+    bool placed;
+
+    // Empty lets the thread run on any core.
+    std::vector<int> cores;
+    // Gives each thread of the kind a single core of cores, round robin by slot, instead of sharing all of them.
+    bool pinEach;
+
+    // SCHED_FIFO at priority (1-99) instead of the default time sharing scheduler at nice. Needs CAP_SYS_NICE.
+    bool fifo;
+    int priority;
+    int nice;
+
+    ThreadPlacement();
+
+    // Places the calling thread, or puts it back where the process started when not placed. Failures are logged and
+    // otherwise ignored, so an unprivileged run still works.
+    void apply(const char* role, int slot = 0) const;
+};
+
+struct ThreadPlacements {
+    ThreadPlacement dispatcher;
+    ThreadPlacement capture;
+    ThreadPlacement workers;
+    // NetworkTables' threads and the log writer.
+    ThreadPlacement publisher;
+};
+
+// The cores of a class: "big" or "little" on heterogeneous CPUs such as the RK3588's A76 and A55 cores, told apart by
+// the kernel's cpu_capacity, or "all". A CPU that reports no capacities, or the same one for every core, only has big
+// cores, so "little" comes back empty, which is logged.
+std::vector<int> coreClass(const std::string& name);
+
+#endif //THREADPLACEMENT_H
@@ -0,0 +1,183 @@
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/objdetect/aruco_detector.hpp>
+#include <opencv2/objdetect/aruco_dictionary.hpp>
+
+#include "../include/json.hpp"
+
+#include "../include/BS_thread_pool.hpp"
+
+#include "AdaptiveThreshold.h"
+#include "Config.h"
+#include "FrameSource.h"
+#include "Log.h"
+#include "Setup.h"
+#include "ThresholdDetector.h"
+
+using namespace cv;
+using namespace std;
+
+// Times the detector front end alone over frames held in memory, at every resolution and OpenCV thread count in
+// bench.json, after decimation: adaptiveThreshold at each of the detector's window sizes against AdaptiveThreshold,
+// and ArucoDetector against ThresholdDetector, on one thread and split into detector.json's detectionTiles on a pool of
+// that many threads. Also counts pixels where the two binarizations differ, which should be none, and the tags each
+// detector finds. Reports JSON.
+//
+// usage: fisheye_threshold_bench [bench.json] [results.json]
+//
+// The other config files are read from the directory bench.json is in.
+
+template<typename Body>
+double meanMillis(int iterations, int frames, Body body) {
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        body(i % frames);
+    }
+    auto elapsed = chrono::steady_clock::now() - start;
+
+    return chrono::duration<double, milli>(elapsed).count() / iterations;
+}
+
+int main(int argc, char** argv) {
+    Log::start();
+
+    string benchPath = argc > 1 ? argv[1] : configPath(defaultConfigDir, "bench.json");
+
+    Config config;
+    BenchConfig bench;
+    if (!loadConfig(filesystem::path(benchPath).parent_path().string(), config) ||
+        !loadBenchConfig(benchPath, config, bench)) {
+        Log::flush();
+        return 1;
+    }
+
+    aruco::DetectorParameters detectParams = config.detector.detectParams;
+    // Refinement happens after either detector in the pipeline, so it's left out of both here.
+    detectParams.cornerRefinementMethod = aruco::CORNER_REFINE_NONE;
+
+    aruco::Dictionary dict = aruco::getPredefinedDictionary(aruco::DICT_APRILTAG_36h11);
+
+    ThresholdParameters thresholdParams = config.detector.threshold;
+
+    int decimation = config.detector.decimation;
+    vector<int> windowSizes = thresholdWindowSizes(detectParams);
+
+    vector<Mat> recording = preloadFrames(bench.source, bench.preloadFrames);
+    if (recording.empty()) {
+        LOG_ERROR("No frames could be read from %s", bench.source.path.c_str());
+        Log::flush();
+        return 1;
+    }
+
+    int iterations = bench.frames;
+
+    nlohmann::json results;
+    results["camera"] = bench.camera;
+    results["decimation"] = decimation;
+    results["windowSizes"] = windowSizes;
+    results["tiles"] = thresholdParams.tiles;
+    results["runs"] = nlohmann::json::array();
+
+    for (Size resolution : bench.resolutions) {
+        Size size(resolution.width / decimation, resolution.height / decimation);
+
+        vector<Mat> images(recording.size());
+        for (int i = 0; i < recording.size(); i++) {
+            Mat gray;
+            if (recording[i].channels() == 1) {
+                gray = recording[i];
+            } else {
+                cvtColor(recording[i], gray, COLOR_BGR2GRAY);
+            }
+            resize(gray, images[i], size, 0, 0, INTER_AREA);
+        }
+
+        int frames = static_cast<int>(images.size());
+
+        for (int threads : bench.threads) {
+            setNumThreads(threads);
+
+            AdaptiveThreshold threshold(windowSizes, detectParams.adaptiveThreshConstant);
+            aruco::ArucoDetector arucoDetector(dict, detectParams);
+            ThresholdDetector thresholdDetector(dict, detectParams, thresholdParams);
+            BS::thread_pool tilePool(threads);
+
+            vector<Mat> reference(windowSizes.size());
+            vector<Mat> binaries;
+            vector<vector<Point2f>> corners;
+            vector<array<Point2f, 4>> quads;
+            vector<int> ids;
+
+            int64_t mismatchedPixels = 0;
+            int arucoTags = 0;
+            int thresholdTags = 0;
+            int tiledTags = 0;
+
+            for (int i = 0; i < frames; i++) {
+                threshold.apply(images[i], binaries);
+                for (int w = 0; w < windowSizes.size(); w++) {
+                    adaptiveThreshold(images[i], reference[w], 255, ADAPTIVE_THRESH_MEAN_C, THRESH_BINARY_INV,
+                        windowSizes[w], detectParams.adaptiveThreshConstant);
+                    mismatchedPixels += countNonZero(reference[w] != binaries[w]);
+                }
+
+                arucoDetector.detectMarkers(images[i], corners, ids);
+                arucoTags += static_cast<int>(ids.size());
+                thresholdDetector.detectMarkers(images[i], quads, ids);
+                thresholdTags += static_cast<int>(ids.size());
+                thresholdDetector.detectMarkers(images[i], quads, ids, &tilePool);
+                tiledTags += static_cast<int>(ids.size());
+            }
+
+            double opencvThresholdMs = meanMillis(iterations, frames, [&](int i) {
+                for (int w = 0; w < windowSizes.size(); w++) {
+                    adaptiveThreshold(images[i], reference[w], 255, ADAPTIVE_THRESH_MEAN_C, THRESH_BINARY_INV,
+                        windowSizes[w], detectParams.adaptiveThreshConstant);
+                }
+            });
+            double simdThresholdMs = meanMillis(iterations, frames, [&](int i) {
+                threshold.apply(images[i], binaries);
+            });
+            double arucoDetectMs = meanMillis(iterations, frames, [&](int i) {
+                arucoDetector.detectMarkers(images[i], corners, ids);
+            });
+            double thresholdDetectMs = meanMillis(iterations, frames, [&](int i) {
+                thresholdDetector.detectMarkers(images[i], quads, ids);
+            });
+            double tiledDetectMs = meanMillis(iterations, frames, [&](int i) {
+                thresholdDetector.detectMarkers(images[i], quads, ids, &tilePool);
+            });
+
+            nlohmann::json run;
+            run["width"] = size.width;
+            run["height"] = size.height;
+            run["threads"] = threads;
+            run["threshold"]["opencvMs"] = opencvThresholdMs;
+            run["threshold"]["simdMs"] = simdThresholdMs;
+            run["threshold"]["mismatchedPixels"] = mismatchedPixels;
+            run["detect"]["opencvMs"] = arucoDetectMs;
+            run["detect"]["simdMs"] = thresholdDetectMs;
+            run["detect"]["opencvTags"] = arucoTags;
+            run["detect"]["simdTags"] = thresholdTags;
+            run["detect"]["tiledMs"] = tiledDetectMs;
+            run["detect"]["tiledTags"] = tiledTags;
+
+            results["runs"].push_back(run);
+        }
+    }
+
+    if (argc > 2) {
+        ofstream resultsJSON(argv[2]);
+        resultsJSON << results.dump(4) << endl;
+    } else {
+        cout << results.dump(4) << endl;
+    }
+
+    Log::flush();
+}
@@ -0,0 +1,580 @@
+#include "ThresholdDetector.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#include <opencv2/core/hal/hal.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "ParallelBlocks.h"
+#include "Trace.h"
+#include "Utils.h"
+
+using namespace std;
+using namespace cv;
+
+// Smaller regions, like most tracker regions, aren't worth splitting.
+static const int minTileRows = 64;
+
+// The eight neighbors of a pixel, clockwise on screen starting east.
+static const Point neighbors[8] = {Point(1, 0), Point(1, 1), Point(0, 1), Point(-1, 1), Point(-1, 0), Point(-1, -1),
+    Point(0, -1), Point(1, -1)};
+static const int east = 0;
+static const int west = 4;
+
+// Border following labels besides background: foreground not yet on a followed border, on one, and on one with
+// background to its east.
+static const schar unvisited = 1;
+static const schar visited = 2;
+static const schar visitedEastEdge = -2;
+
+// Step 3 of Suzuki and Abe's border following ("Topological Structural Analysis of Digitized Binary Images by Border
+// Following", 1985), the algorithm findContours implements. Follows the border through start, whose background
+// neighbor lies in direction from, and marks it in labels. Keeps up to maxPoints of its pixels in contour, in unpadded
+// coordinates, and returns its full length.
+static int followBorder(Mat& labels, Point start, int from, int maxPoints, vector<Point>& contour) {
+    contour.clear();
+
+    auto label = [&labels](Point point) -> schar& {
+        return labels.at<schar>(point.y, point.x);
+    };
+
+    int firstDirection = -1;
+    for (int turn = 1; turn <= 8; turn++) {
+        int direction = (from + turn) & 7;
+        if (label(start + neighbors[direction]) != 0) {
+            firstDirection = direction;
+            break;
+        }
+    }
+
+    // An isolated pixel is a border of its own.
+    if (firstDirection < 0) {
+        label(start) = visitedEastEdge;
+        contour.push_back(start - Point(1, 1));
+        return 1;
+    }
+
+    Point firstNeighbor = start + neighbors[firstDirection];
+    Point current = start;
+    // Toward the border pixel before current.
+    int back = firstDirection;
+    int length = 0;
+
+    while (true) {
+        // Counterclockwise from the previous border pixel to the next one. The previous one is foreground, so it ends
+        // the search at the latest.
+        int direction = back;
+        bool eastEdge = false;
+        Point next;
+        while (true) {
+            direction = (direction + 7) & 7;
+            next = current + neighbors[direction];
+            if (label(next) != 0) {
+                break;
+            }
+            eastEdge = eastEdge || direction == east;
+        }
+
+        schar& here = label(current);
+        if (eastEdge) {
+            here = visitedEastEdge;
+        } else if (here == unvisited) {
+            here = visited;
+        }
+
+        if (length < maxPoints) {
+            contour.push_back(current - Point(1, 1));
+        }
+        length += 1;
+
+        if (next == start && current == firstNeighbor) {
+            return length;
+        }
+
+        back = (direction + 4) & 7;
+        current = next;
+    }
+}
+
+// approxPolyDP on a closed contour: split it between two far apart points, keep splitting each run at the point
+// farthest from its chord while that's more than epsilon off it, then drop vertices left almost on the line between
+// their neighbors. splits is the work stack.
+static void approximatePolygon(const vector<Point>& contour, double epsilon, vector<pair<int, int>>& splits,
+    vector<Point>& polygon) {
+    polygon.clear();
+
+    int count = static_cast<int>(contour.size());
+    double epsilonSquared = epsilon * epsilon;
+
+    // approxPolyDP's estimate of the farthest pair: hop to the point farthest from the last one, three times.
+    int first = 0;
+    int second = 0;
+    double farthest = 0;
+    for (int hop = 0; hop < 3; hop++) {
+        first = second;
+        farthest = 0;
+
+        for (int j = 1; j < count; j++) {
+            int i = (first + j) % count;
+            Point difference = contour[i] - contour[first];
+            if (difference.ddot(difference) > farthest) {
+                farthest = difference.ddot(difference);
+                second = i;
+            }
+        }
+    }
+
+    if (farthest <= epsilonSquared) {
+        polygon.push_back(contour[first]);
+        return;
+    }
+
+    splits.clear();
+    splits.emplace_back(second, first);
+    splits.emplace_back(first, second);
+
+    while (!splits.empty()) {
+        auto [begin, end] = splits.back();
+        splits.pop_back();
+
+        Point start = contour[begin];
+        Point chord = contour[end] - start;
+
+        double farthestOff = 0;
+        int split = begin;
+        for (int i = (begin + 1) % count; i != end; i = (i + 1) % count) {
+            Point offset = contour[i] - start;
+            double off = abs(static_cast<double>(offset.y * chord.x - offset.x * chord.y));
+            if (off > farthestOff) {
+                farthestOff = off;
+                split = i;
+            }
+        }
+
+        if (farthestOff * farthestOff <= epsilonSquared * chord.ddot(chord)) {
+            polygon.push_back(start);
+        } else {
+            splits.emplace_back(split, end);
+            splits.emplace_back(begin, split);
+        }
+    }
+
+    // The vertex after each one dropped is kept without a check, as approxPolyDP does.
+    int vertices = static_cast<int>(polygon.size());
+    Point firstVertex = polygon[0];
+    Point previous = polygon[vertices - 1];
+    int kept = 0;
+
+    for (int i = 0; i < vertices; i++) {
+        Point vertex = polygon[i];
+        Point next = i + 1 < vertices ? polygon[i + 1] : firstVertex;
+
+        Point chord = next - previous;
+        Point offset = vertex - previous;
+        double off = abs(static_cast<double>(offset.x * chord.y - offset.y * chord.x));
+
+        bool drop = vertices - (i - kept) > 2 && chord.x != 0 && chord.y != 0 && offset.ddot(next - vertex) >= 0 &&
+            off * off <= 0.5 * epsilonSquared * chord.ddot(chord);
+
+        if (drop) {
+            if (i + 1 < vertices) {
+                polygon[kept++] = next;
+                previous = next;
+                i += 1;
+            }
+            continue;
+        }
+
+        polygon[kept++] = vertex;
+        previous = vertex;
+    }
+
+    polygon.resize(kept);
+}
+
+// The level threshold picks with THRESH_OTSU: the one with the largest variance between the two classes it splits.
+static int otsuThreshold(const Mat& image) {
+    int histogram[256] = {0};
+    for (int y = 0; y < image.rows; y++) {
+        const uchar* row = image.ptr<uchar>(y);
+        for (int x = 0; x < image.cols; x++) {
+            histogram[row[x]] += 1;
+        }
+    }
+
+    double scale = 1.0 / static_cast<double>(image.total());
+    double mean = 0;
+    for (int i = 0; i < 256; i++) {
+        mean += i * static_cast<double>(histogram[i]);
+    }
+    mean *= scale;
+
+    double below = 0;
+    double belowMean = 0;
+    double maxVariance = 0;
+    int level = 0;
+
+    for (int i = 0; i < 256; i++) {
+        double share = histogram[i] * scale;
+        belowMean *= below;
+        below += share;
+        double above = 1.0 - below;
+
+        if (min(below, above) < FLT_EPSILON || max(below, above) > 1.0 - FLT_EPSILON) {
+            continue;
+        }
+
+        belowMean = (belowMean + i * share) / below;
+        double aboveMean = (mean - below * belowMean) / above;
+        double variance = below * above * (belowMean - aboveMean) * (belowMean - aboveMean);
+
+        if (variance > maxVariance) {
+            maxVariance = variance;
+            level = i;
+        }
+    }
+
+    return level;
+}
+
+ThresholdParameters::ThresholdParameters() {
+    this->simd = false;
+    this->tiles = 1;
+    this->tileOverlap = 0.5;
+}
+
+vector<int> thresholdWindowSizes(const aruco::DetectorParameters& detectParams) {
+    vector<int> windowSizes;
+
+    int step = max(1, detectParams.adaptiveThreshWinSizeStep);
+    for (int window = detectParams.adaptiveThreshWinSizeMin; window <= detectParams.adaptiveThreshWinSizeMax;
+        window += step) {
+        windowSizes.push_back(window);
+    }
+
+    return windowSizes;
+}
+
+ThresholdDetector::ThresholdDetector(const aruco::Dictionary& dictionary,
+    const aruco::DetectorParameters& detectParams, ThresholdParameters thresholdParams):
+dictionary(dictionary), params(detectParams), thresholdParams(thresholdParams),
+threshold(thresholdWindowSizes(detectParams), detectParams.adaptiveThreshConstant) {
+    tiles.resize(max(1, thresholdParams.tiles));
+
+    bytes.resize((dictionary.markerSize * dictionary.markerSize + 7) / 8);
+}
+
+void ThresholdDetector::detectMarkers(const Mat& image, vector<array<Point2f, 4>>& corners, vector<int>& ids,
+    BS::thread_pool* pool) {
+    corners.clear();
+    ids.clear();
+
+    int tileCount = pool == nullptr ? 1 : clamp(image.rows / minTileRows, 1, static_cast<int>(tiles.size()));
+
+    if (tileCount == 1) {
+        // On this thread rather than through apply's parallel_for_, which allocates a job per call whenever OpenCV
+        // has threads of its own.
+        threshold.prepare(image, binaries);
+        threshold.applyRows(image, binaries, 0, image.rows);
+
+        tiles[0].candidates.clear();
+        for (const Mat& binary : binaries) {
+            findCandidates(binary, image.size(), 0, tiles[0]);
+        }
+    } else {
+        // Every band's quad search reads rows its neighbors threshold, so all thresholding finishes first.
+        threshold.prepare(image, binaries);
+        parallelBlocks(pool, tileCount, [this, &image, tileCount](int tile) {
+            TraceSpan span("threshold tile");
+            threshold.applyRows(image, binaries, tile * image.rows / tileCount, (tile + 1) * image.rows / tileCount);
+        });
+
+        int overlap = min(image.rows / 2, cvRound(thresholdParams.tileOverlap * image.rows));
+        int bandRows = (image.rows + (tileCount - 1) * overlap + tileCount - 1) / tileCount;
+
+        parallelBlocks(pool, tileCount, [this, &image, tileCount, overlap, bandRows](int tile) {
+            TraceSpan span("quad tile");
+
+            int top = tile * (bandRows - overlap);
+            int bottom = tile == tileCount - 1 ? image.rows : min(image.rows, top + bandRows);
+
+            tiles[tile].candidates.clear();
+            for (const Mat& binary : binaries) {
+                findCandidates(binary.rowRange(top, bottom), image.size(), top, tiles[tile]);
+            }
+        });
+    }
+
+    candidates.clear();
+    for (int t = 0; t < tileCount; t++) {
+        candidates.insert(candidates.end(), tiles[t].candidates.begin(), tiles[t].candidates.end());
+    }
+
+    // A tag's border is found once per window, and once more by its inner edge, and again by every band holding it.
+    // Only the largest of each group of nearby candidates is decoded.
+    sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.perimeter > b.perimeter;
+    });
+
+    kept.clear();
+    for (const Candidate& candidate : candidates) {
+        if (!tooClose(candidate)) {
+            kept.push_back(candidate);
+        }
+    }
+
+    for (Candidate& candidate : kept) {
+        int id;
+        if (identify(image, candidate, id)) {
+            corners.push_back(candidate.corners);
+            ids.push_back(id);
+        }
+    }
+}
+
+void ThresholdDetector::findCandidates(const Mat& binary, Size imageSize, int top, Tile& tile) {
+    // Sized against the whole frame, so a band accepts the same quads the frame would.
+    int maxDimension = max(imageSize.width, imageSize.height);
+    double minPerimeter = params.minMarkerPerimeterRate * maxDimension;
+    double maxPerimeter = params.maxMarkerPerimeterRate * maxDimension;
+
+    if (params.useAruco3Detection) {
+        minPerimeter = 4.0 * params.minSideLengthCanonicalImg;
+    }
+
+    // Longer borders are rejected anyway, so only their length is kept.
+    int maxPoints = static_cast<int>(maxPerimeter) + 1;
+
+    // The band with a background border, as findContours pads it, and its foreground marked unvisited.
+    Mat labels = fitBuffer(tile.labelBuffer, Size(binary.cols + 2, binary.rows + 2), CV_8SC1);
+    memset(labels.ptr(0), 0, labels.cols);
+    memset(labels.ptr(labels.rows - 1), 0, labels.cols);
+
+    for (int y = 0; y < binary.rows; y++) {
+        const uchar* source = binary.ptr<uchar>(y);
+        schar* target = labels.ptr<schar>(y + 1);
+
+        target[0] = 0;
+        target[binary.cols + 1] = 0;
+        for (int x = 0; x < binary.cols; x++) {
+            target[x + 1] = source[x] != 0 ? unvisited : 0;
+        }
+    }
+
+    // Every border starts where a raster scan first meets it, from the background on its left for an outer border
+    // and on its right for a hole's.
+    for (int y = 1; y <= binary.rows; y++) {
+        const schar* row = labels.ptr<schar>(y);
+
+        for (int x = 1; x <= binary.cols; x++) {
+            int from;
+            if (row[x] == unvisited && row[x - 1] == 0) {
+                from = west;
+            } else if (row[x] >= unvisited && row[x + 1] == 0) {
+                from = east;
+            } else {
+                continue;
+            }
+
+            double perimeter = static_cast<double>(followBorder(labels, Point(x, y), from, maxPoints, tile.contour));
+            if (perimeter >= minPerimeter && perimeter <= maxPerimeter) {
+                addCandidate(tile.contour, perimeter, binary.size(), top, tile);
+            }
+        }
+    }
+}
+
+void ThresholdDetector::addCandidate(const vector<Point>& contour, double perimeter, Size bandSize, int top,
+    Tile& tile) {
+    // Within a band this also drops quads cut by the band's edge; the band overlapping it sees them whole.
+    int border = params.minDistanceToBorder;
+
+    vector<Point>& polygon = tile.polygon;
+    approximatePolygon(contour, perimeter * params.polygonalApproxAccuracyRate, tile.splits, polygon);
+    if (polygon.size() != 4 || !isContourConvex(polygon)) {
+        return;
+    }
+
+    double minSideSquared = DBL_MAX;
+    bool nearBorder = false;
+    for (int a = 0; a < 4; a++) {
+        Point side = polygon[a] - polygon[(a + 1) % 4];
+        minSideSquared = min(minSideSquared, static_cast<double>(side.dot(side)));
+
+        nearBorder = nearBorder || polygon[a].x < border || polygon[a].y < border ||
+            polygon[a].x > bandSize.width - 1 - border || polygon[a].y > bandSize.height - 1 - border;
+    }
+
+    double minCornerDistance = perimeter * params.minCornerDistanceRate;
+    if (nearBorder || minSideSquared < minCornerDistance * minCornerDistance) {
+        return;
+    }
+
+    Candidate candidate;
+    for (int a = 0; a < 4; a++) {
+        candidate.corners[a] = Point2f(static_cast<float>(polygon[a].x), static_cast<float>(polygon[a].y + top));
+    }
+    candidate.perimeter = perimeter;
+
+    // Clockwise in image coordinates, the order ArucoDetector hands corners out in.
+    Point2f first = candidate.corners[1] - candidate.corners[0];
+    Point2f second = candidate.corners[2] - candidate.corners[0];
+    if (first.x * second.y - first.y * second.x < 0) {
+        swap(candidate.corners[1], candidate.corners[3]);
+    }
+
+    tile.candidates.push_back(candidate);
+}
+
+bool ThresholdDetector::tooClose(const Candidate& candidate) const {
+    for (const Candidate& other : kept) {
+        double limit = params.minMarkerDistanceRate * min(candidate.perimeter, other.perimeter);
+
+        // Mean squared corner distance, over every way of lining the two quads' corners up.
+        for (int shift = 0; shift < 4; shift++) {
+            double distanceSquared = 0;
+            for (int a = 0; a < 4; a++) {
+                Point2f difference = candidate.corners[a] - other.corners[(a + shift) % 4];
+                distanceSquared += difference.dot(difference);
+            }
+
+            if (distanceSquared / 4 < limit * limit) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool ThresholdDetector::identify(const Mat& image, Candidate& candidate, int& id) {
+    int borderBits = params.markerBorderBits;
+    int cellsPerSide = dictionary.markerSize + 2 * borderBits;
+    int cellSize = params.perspectiveRemovePixelPerCell;
+    int warpedSize = cellsPerSide * cellSize;
+    double far = static_cast<double>(warpedSize - 1);
+
+    // From the square of side far onto the candidate, to sample it nearest neighbor as warpPerspective would.
+    Matx33d homography;
+    if (!unitSquareHomography(candidate.corners.data(), homography)) {
+        return false;
+    }
+    homography = homography * Matx33d(1 / far, 0, 0, 0, 1 / far, 0, 0, 0, 1);
+
+    warped.create(warpedSize, warpedSize, CV_8UC1);
+    for (int y = 0; y < warpedSize; y++) {
+        uchar* row = warped.ptr<uchar>(y);
+
+        for (int x = 0; x < warpedSize; x++) {
+            double w = homography(2, 0) * x + homography(2, 1) * y + homography(2, 2);
+            w = w != 0 ? 1 / w : 0;
+
+            int u = cvRound((homography(0, 0) * x + homography(0, 1) * y + homography(0, 2)) * w);
+            int v = cvRound((homography(1, 0) * x + homography(1, 1) * y + homography(1, 2)) * w);
+
+            row[x] = u >= 0 && v >= 0 && u < image.cols && v < image.rows ? image.at<uchar>(v, u) : 0;
+        }
+    }
+
+    // Deviation inside the outer half cells. A flat patch, all border or all background, can't hold a tag's bits.
+    int inset = cellSize / 2;
+    int innerSize = warpedSize - cellSize;
+    double sum = 0;
+    double sumSquares = 0;
+    for (int y = inset; y < inset + innerSize; y++) {
+        const uchar* row = warped.ptr<uchar>(y);
+        for (int x = inset; x < inset + innerSize; x++) {
+            sum += row[x];
+            sumSquares += static_cast<double>(row[x]) * row[x];
+        }
+    }
+
+    double area = static_cast<double>(innerSize) * innerSize;
+    double mean = sum / area;
+    if (sqrt(max(0.0, sumSquares / area - mean * mean)) < params.minOtsuStdDev) {
+        return false;
+    }
+
+    int level = otsuThreshold(warped);
+
+    int margin = static_cast<int>(params.perspectiveRemoveIgnoredMarginPerCell * cellSize);
+    int inner = cellSize - 2 * margin;
+
+    bits.create(cellsPerSide, cellsPerSide, CV_8UC1);
+    int borderErrors = 0;
+
+    for (int y = 0; y < cellsPerSide; y++) {
+        for (int x = 0; x < cellsPerSide; x++) {
+            int set = 0;
+            for (int py = y * cellSize + margin; py < y * cellSize + margin + inner; py++) {
+                const uchar* row = warped.ptr<uchar>(py);
+                for (int px = x * cellSize + margin; px < x * cellSize + margin + inner; px++) {
+                    set += row[px] > level ? 1 : 0;
+                }
+            }
+            bits.at<uchar>(y, x) = set > inner * inner / 2 ? 1 : 0;
+
+            bool borderCell = y < borderBits || y >= cellsPerSide - borderBits || x < borderBits ||
+                x >= cellsPerSide - borderBits;
+            if (borderCell) {
+                borderErrors += bits.at<uchar>(y, x);
+            }
+        }
+    }
+
+    int maxBorderErrors = static_cast<int>(dictionary.markerSize * dictionary.markerSize *
+        params.maxErroneousBitsInBorderRate);
+    if (borderErrors > maxBorderErrors) {
+        return false;
+    }
+
+    int rotation;
+    if (!decode(id, rotation)) {
+        return false;
+    }
+
+    rotate(candidate.corners.begin(), candidate.corners.end() - rotation, candidate.corners.end());
+    return true;
+}
+
+bool ThresholdDetector::decode(int& id, int& rotation) {
+    int markerSize = dictionary.markerSize;
+    int borderBits = params.markerBorderBits;
+
+    // Row by row, most significant bit first, as getByteListFromBits packs a marker's unrotated bits.
+    fill(bytes.begin(), bytes.end(), 0);
+    for (int bit = 0; bit < markerSize * markerSize; bit++) {
+        uint8_t& byte = bytes[bit / 8];
+        byte = static_cast<uint8_t>(byte << 1 | bits.at<uchar>(bit / markerSize + borderBits,
+            bit % markerSize + borderBits));
+    }
+
+    int byteCount = static_cast<int>(bytes.size());
+    int maxCorrection = static_cast<int>(dictionary.maxCorrectionBits * params.errorCorrectionRate);
+
+    // Each marker's row holds all four of its rotations.
+    for (int marker = 0; marker < dictionary.bytesList.rows; marker++) {
+        const uchar* rotations = dictionary.bytesList.ptr(marker);
+
+        int bestDistance = markerSize * markerSize + 1;
+        int bestRotation = -1;
+        for (int r = 0; r < 4; r++) {
+            int distance = hal::normHamming(rotations + r * byteCount, bytes.data(), byteCount);
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                bestRotation = r;
+            }
+        }
+
+        if (bestDistance <= maxCorrection) {
+            id = marker;
+            rotation = bestRotation;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,86 @@
+#ifndef THRESHOLDDETECTOR_H
+#define THRESHOLDDETECTOR_H
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/objdetect/aruco_detector.hpp>
+#include <opencv2/objdetect/aruco_dictionary.hpp>
+
+#include "../include/BS_thread_pool.hpp"
+
+#include "AdaptiveThreshold.h"
+
+struct ThresholdParameters {
+    // Detect with ThresholdDetector rather than ArucoDetector.
+    bool simd;
+
+    // Horizontal bands a frame's thresholding and quad search are split into, each run on a pool thread, so one frame
+    // finishes sooner the more threads are free. 1 keeps every frame on a single thread.
+    int tiles;
+    // How much neighboring bands overlap, as a fraction of the frame's height. Quads cut by a band's edge are dropped,
+    // so this is also the tallest tag that's still found where it straddles a cut.
+    double tileOverlap;
+
+    ThresholdParameters();
+};
+
+// Finds tags like ArucoDetector::detectMarkers, with AdaptiveThreshold in place of its per-window adaptiveThreshold
+// calls. Quads are filtered, grouped and decoded the way ArucoDetector does for non-inverted markers, except that bits
+// are always sampled from the image given rather than an ArUco 3 pyramid level. Corners are left unrefined.
+//
+// Contours, polygons and bit decoding are done here rather than by findContours, approxPolyDP, warpPerspective and
+// Dictionary::identify, which all allocate, so once every buffer has grown to the largest frame a call on a single
+// tile doesn't touch the heap.
+class ThresholdDetector {
+    public:
+        ThresholdDetector(const cv::aruco::Dictionary& dictionary, const cv::aruco::DetectorParameters& detectParams,
+            ThresholdParameters thresholdParams);
+
+        // Splits the frame into tiles on pool when one is given; tiles are grouped and decoded on the calling thread.
+        void detectMarkers(const cv::Mat& image, std::vector<std::array<cv::Point2f, 4>>& corners,
+            std::vector<int>& ids, BS::thread_pool* pool = nullptr);
+    private:
+        struct Candidate {
+            std::array<cv::Point2f, 4> corners;
+            double perimeter;
+        };
+
+        struct Tile {
+            cv::Mat labelBuffer;
+            std::vector<cv::Point> contour;
+            std::vector<std::pair<int, int>> splits;
+            std::vector<cv::Point> polygon;
+            std::vector<Candidate> candidates;
+        };
+
+        cv::aruco::Dictionary dictionary;
+        cv::aruco::DetectorParameters params;
+        ThresholdParameters thresholdParams;
+        AdaptiveThreshold threshold;
+
+        std::vector<cv::Mat> binaries;
+        std::vector<Tile> tiles;
+        std::vector<Candidate> candidates;
+        std::vector<Candidate> kept;
+        cv::Mat warped;
+        cv::Mat bits;
+        std::vector<uint8_t> bytes;
+
+        // binary is a band of the frame starting at row top; candidates are kept in frame coordinates.
+        void findCandidates(const cv::Mat& binary, cv::Size imageSize, int top, Tile& tile);
+        void addCandidate(const std::vector<cv::Point>& contour, double perimeter, cv::Size bandSize, int top,
+            Tile& tile);
+        bool tooClose(const Candidate& candidate) const;
+        bool identify(const cv::Mat& image, Candidate& candidate, int& id);
+        // Dictionary::identify on the inner bits of bits.
+        bool decode(int& id, int& rotation);
+};
+
+// The window sizes ArucoDetector thresholds at for these parameters.
+std::vector<int> thresholdWindowSizes(const cv::aruco::DetectorParameters& detectParams);
+
+#endif //THRESHOLDDETECTOR_H
@@ -0,0 +1,176 @@
+#include "Trace.h"
+
+#include <csignal>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Log.h"
+
+using namespace std;
+
+struct TraceEvent {
+    const char* name;
+    int64_t start;
+    int64_t end;
+    int64_t frame;
+    int camera;
+};
+
+// Written only by its thread. head counts every span ever recorded, so the live window is the last capacity of them.
+struct TraceBuffer {
+    vector<TraceEvent> events;
+    atomic<uint64_t> head;
+    string threadName;
+    long threadId;
+};
+
+static mutex buffersMutex;
+static vector<unique_ptr<TraceBuffer>> buffers;
+static uint64_t bufferCapacity = 0;
+
+static thread_local TraceBuffer* localBuffer = nullptr;
+
+static TraceBuffer* threadBuffer() {
+    if (localBuffer == nullptr) {
+        unique_ptr<TraceBuffer> buffer = make_unique<TraceBuffer>();
+        buffer->events.resize(bufferCapacity);
+        buffer->head.store(0);
+        buffer->threadId = syscall(SYS_gettid);
+
+        lock_guard<mutex> lock(buffersMutex);
+        localBuffer = buffer.get();
+        buffers.push_back(move(buffer));
+    }
+
+    return localBuffer;
+}
+
+void Trace::enable(int eventsPerThread) {
+    // A power of two so the ring index is a mask.
+    bufferCapacity = 1;
+    while (bufferCapacity < eventsPerThread) {
+        bufferCapacity <<= 1;
+    }
+
+    active.store(true);
+}
+
+void Trace::nameThread(const string& name) {
+    if (!enabled()) {
+        return;
+    }
+
+    TraceBuffer* buffer = threadBuffer();
+
+    lock_guard<mutex> lock(buffersMutex);
+    buffer->threadName = name;
+}
+
+void Trace::record(const char* name, int64_t start, int64_t end, int camera, int64_t frame) {
+    TraceBuffer* buffer = threadBuffer();
+
+    uint64_t head = buffer->head.load(memory_order_relaxed);
+    buffer->events[head & (bufferCapacity - 1)] = {name, start, end, frame, camera};
+    buffer->head.store(head + 1, memory_order_release);
+}
+
+bool Trace::dump(const string& path) {
+    ofstream out(path);
+    if (!out) {
+        LOG_ERROR("Could not write trace to %s", path.c_str());
+        return false;
+    }
+
+    long processId = getpid();
+    bool first = true;
+
+    out << fixed << setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    lock_guard<mutex> lock(buffersMutex);
+
+    vector<TraceEvent> events;
+    for (const unique_ptr<TraceBuffer>& buffer : buffers) {
+        if (!buffer->threadName.empty()) {
+            out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << processId
+                << ",\"tid\":" << buffer->threadId << ",\"args\":{\"name\":\"" << buffer->threadName << "\"}}";
+            first = false;
+        }
+
+        uint64_t head = buffer->head.load(memory_order_acquire);
+        uint64_t begin = head > bufferCapacity ? head - bufferCapacity : 0;
+
+        events.clear();
+        for (uint64_t a = begin; a < head; a++) {
+            events.push_back(buffer->events[a & (bufferCapacity - 1)]);
+        }
+
+        // The owning thread may have lapped the oldest copied spans while they were read. The fence keeps the copies
+        // above from being reordered past the second load. A head of h means slot h is being written, so spans
+        // before h + 1 - bufferCapacity may be torn.
+        atomic_thread_fence(memory_order_acquire);
+        uint64_t overwritten = buffer->head.load(memory_order_relaxed);
+        uint64_t valid = overwritten + 1 > bufferCapacity ? overwritten + 1 - bufferCapacity : 0;
+
+        for (uint64_t a = max(begin, valid); a < head; a++) {
+            const TraceEvent& event = events[a - begin];
+
+            out << (first ? "" : ",") << "\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":" << processId
+                << ",\"tid\":" << buffer->threadId << ",\"ts\":" << event.start / 1000.0
+                << ",\"dur\":" << (event.end - event.start) / 1000.0;
+
+            if (event.camera >= 0 || event.frame >= 0) {
+                out << ",\"args\":{";
+                if (event.camera >= 0) {
+                    out << "\"camera\":" << event.camera << (event.frame >= 0 ? "," : "");
+                }
+                if (event.frame >= 0) {
+                    out << "\"frame\":" << event.frame;
+                }
+                out << "}";
+            }
+
+            out << "}";
+            first = false;
+        }
+    }
+
+    out << "\n]}" << endl;
+
+    LOG_INFO("Wrote trace to %s", path.c_str());
+    return static_cast<bool>(out);
+}
+
+void Trace::dumpOnSignal(const string& path) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    // A plain thread waiting in sigwait can take locks and do I/O, which a signal handler couldn't.
+    thread([signals, path] {
+        while (true) {
+            int signal;
+            if (sigwait(&signals, &signal) != 0) {
+                continue;
+            }
+
+            dump(path);
+
+            if (signal != SIGUSR1) {
+                Log::flush();
+                _exit(128 + signal);
+            }
+        }
+    }).detach();
+}
@@ -0,0 +1,82 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Timeline tracing of the pipeline's stages, exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+// Every thread records into its own fixed size ring buffer, so recording never locks and only the newest
+// eventsPerThread spans of each thread are kept. While disabled a span costs one relaxed load.
+class Trace {
+    public:
+        // Must be called before any thread records, and before threads that should be traced are started.
+        static void enable(int eventsPerThread);
+
+        static bool enabled() {
+            return active.load(std::memory_order_relaxed);
+        }
+
+        static int64_t now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // Labels the calling thread's row in the trace.
+        static void nameThread(const std::string& name);
+
+        // name must outlive the trace, so pass string literals. Negative camera and frame values are left out.
+        static void record(const char* name, int64_t start, int64_t end, int camera, int64_t frame);
+
+        // Safe to call while other threads keep recording; spans being overwritten during the dump are skipped.
+        static bool dump(const std::string& path);
+
+        // Blocks SIGUSR1, SIGINT and SIGTERM in the calling thread and every thread it starts afterwards, and handles
+        // them on a dedicated thread instead: SIGUSR1 dumps the trace to path, SIGINT and SIGTERM dump it and exit.
+        static void dumpOnSignal(const std::string& path);
+    private:
+        inline static std::atomic<bool> active = false;
+};
+
+// Records the time between its construction and destruction as one span.
+class TraceSpan {
+    public:
+        explicit TraceSpan(const char* name, int camera = -1, int64_t frame = -1) {
+            if (Trace::enabled()) {
+                this->name = name;
+                this->camera = camera;
+                this->frame = frame;
+                this->start = Trace::now();
+            } else {
+                this->name = nullptr;
+            }
+        }
+
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+
+        ~TraceSpan() {
+            end();
+        }
+
+        // Closes the span early; later calls and the destructor do nothing.
+        void end() {
+            if (name != nullptr) {
+                Trace::record(name, start, Trace::now(), camera, frame);
+                name = nullptr;
+            }
+        }
+
+        // For spans that only learn which frame they handled partway through.
+        void setFrame(int64_t frame) {
+            this->frame = frame;
+        }
+    private:
+        const char* name;
+        int camera;
+        int64_t frame;
+        int64_t start;
+};
+
+#endif //TRACE_H
@@ -1,26 +1,120 @@
 #include "Utils.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <vector>
+#include <opencv2/core/matx.hpp>
 #include <opencv2/core/types.hpp>
 
 using namespace std;
 using namespace cv;
 
-Apriltag::Apriltag(vector<Point2f> corners, int id) {
+Apriltag::Apriltag() {
+    this->id = -1;
+}
+
+Apriltag::Apriltag(const array<Point2f, 4>& corners, int id) {
     this->corners = corners;
     this->id = id;
 }
 
-Pose::Pose(Mat tvec, Mat rmat) {
+Pose::Pose() = default;
+
+Pose::Pose(const Matx31d& tvec, const Matx33d& rmat) {
     this->tvec = tvec;
     this->rmat = rmat;
 }
 
-CameraThreadset::CameraThreadset(int totalThreads, int maxTagSightings) {
+FrameScratch::FrameScratch(int maxTags):
+apriltags(maxTags) {
+    corners.reserve(maxTags);
+    ids.reserve(maxTags);
+    arucoCorners.reserve(maxTags);
+    rois.reserve(maxTags);
+
+    distortedCorners.reserve(maxTags * 4);
+    normalizedCorners.reserve(maxTags * 4);
+    poses.reserve(maxTags);
+    reprojectionErrors.reserve(maxTags);
+
+    fieldPoints.reserve(maxTags * 4);
+    fieldImagePoints.reserve(maxTags * 4);
+
+    record.reserve(256 + maxTags * 128);
+
+    this->tagCount = 0;
+    this->fieldReprojectionError = 0;
+    this->fieldTagCount = 0;
+}
+
+Mat fitBuffer(Mat& buffer, Size size, int type) {
+    size_t bytes = static_cast<size_t>(size.area()) * CV_ELEM_SIZE(type);
+    if (buffer.empty() || buffer.total() * buffer.elemSize() < bytes) {
+        buffer.create(1, static_cast<int>(max<size_t>(bytes, 1)), CV_8UC1);
+    }
+
+    return Mat(size, type, buffer.data);
+}
+
+bool unitSquareHomography(const Point2f* points, Matx33d& homography) {
+    double x0 = points[0].x, y0 = points[0].y;
+    double x1 = points[1].x, y1 = points[1].y;
+    double x2 = points[2].x, y2 = points[2].y;
+    double x3 = points[3].x, y3 = points[3].y;
+
+    double sx = x0 - x1 + x2 - x3;
+    double sy = y0 - y1 + y2 - y3;
+    double dx1 = x1 - x2, dx2 = x3 - x2;
+    double dy1 = y1 - y2, dy2 = y3 - y2;
+
+    double den = dx1 * dy2 - dx2 * dy1;
+    if (abs(den) < 1e-12) {
+        return false;
+    }
+
+    double g = (sx * dy2 - dx2 * sy) / den;
+    double h = (dx1 * sy - sx * dy1) / den;
+
+    homography = Matx33d(x1 - x0 + g * x1, x3 - x0 + h * x3, x0,
+        y1 - y0 + g * y1, y3 - y0 + h * y3, y0,
+        g, h, 1);
+    return true;
+}
+
+CameraThreadset::CameraThreadset(int totalThreads) {
     this->totalThreads = totalThreads;
     this->activeThreads = 0;
-    this->tagSightings = 0;
-    this->maxTagSightings = maxTagSightings;
     this->lastThreadActivateTime = 0;
+    this->iterations = 0;
+    this->usefulIterations = 0;
+    this->busyMicros = 0;
+}
+
+// The counts only bound how many iterations run, they don't publish any data, so relaxed ordering is enough.
+bool CameraThreadset::admit(int64_t now) {
+    int active = activeThreads.load(memory_order_relaxed);
+    do {
+        if (active >= totalThreads.load(memory_order_relaxed)) {
+            return false;
+        }
+    } while (!activeThreads.compare_exchange_weak(active, active + 1, memory_order_relaxed));
+
+    lastThreadActivateTime.store(now, memory_order_relaxed);
+    return true;
+}
+
+void CameraThreadset::release() {
+    activeThreads.fetch_sub(1, memory_order_relaxed);
+}
+
+bool CameraThreadset::full() const {
+    return activeThreads.load(memory_order_relaxed) >= totalThreads.load(memory_order_relaxed);
+}
+
+void CameraThreadset::recordIteration(bool foundTags, int64_t busyMicros) {
+    iterations.fetch_add(1, memory_order_relaxed);
+    usefulIterations.fetch_add(foundTags ? 1 : 0, memory_order_relaxed);
+    this->busyMicros.fetch_add(busyMicros, memory_order_relaxed);
 }
 
@@ -1,31 +1,102 @@
 #ifndef UTILS_H
 #define UTILS_H
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
 #include <vector>
 #include <opencv2/core/mat.hpp>
+#include <opencv2/core/matx.hpp>
 #include <opencv2/core/types.hpp>
 
 struct Apriltag {
-    std::vector<cv::Point2f> corners;
+    std::array<cv::Point2f, 4> corners;
     int id;
 
-    Apriltag(std::vector<cv::Point2f> corners, int id);
+    Apriltag();
+    Apriltag(const std::array<cv::Point2f, 4>& corners, int id);
 };
 
+// tvec is a Matx31d rather than a Vec3d because Vec's user-defined copy constructor would make Pose non-trivially
+// copyable.
 struct Pose {
-    cv::Mat tvec;
-    cv::Mat rmat;
+    cv::Matx31d tvec;
+    cv::Matx33d rmat;
 
-    Pose(cv::Mat tvec, cv::Mat rmat);
+    Pose();
+    Pose(const cv::Matx31d& tvec, const cv::Matx33d& rmat);
 };
 
-struct CameraThreadset {
-    int totalThreads;
-    int activeThreads;
-    int tagSightings;
-    int maxTagSightings;
-    int64_t lastThreadActivateTime;
+static_assert(std::is_trivially_copyable_v<Apriltag>);
+static_assert(std::is_trivially_copyable_v<Pose>);
 
-    CameraThreadset(int totalThreads, int maxTagSightings);
+// Per-worker buffers reused across frames so steady-state iterations don't touch the heap.
+struct FrameScratch {
+    std::vector<std::array<cv::Point2f, 4>> corners;
+    std::vector<int> ids;
+    // ArucoDetector only hands corners out as one vector per tag; they're copied into corners.
+    std::vector<std::vector<cv::Point2f>> arucoCorners;
+
+    std::vector<Apriltag> apriltags;
+    int tagCount;
+
+    std::vector<cv::Rect> rois;
+
+    std::vector<cv::Point2f> distortedCorners;
+    std::vector<cv::Point2f> normalizedCorners;
+    std::vector<Pose> poses;
+    std::vector<double> reprojectionErrors;
+
+    std::vector<cv::Point3d> fieldPoints;
+    std::vector<cv::Point2d> fieldImagePoints;
+    Pose fieldPose;
+    double fieldReprojectionError;
+    int fieldTagCount;
+
+    std::vector<uint8_t> record;
+
+    cv::Mat gray;
+    cv::Mat decimatedBuffer;
+    std::vector<int> decimateSums;
+    cv::Mat refineBuffer;
+    std::vector<float> refineWeights;
+
+    explicit FrameScratch(int maxTags);
+};
+
+// A size x type image over buffer's memory, which is only reallocated when it's too small. Images whose size changes
+// every frame, like tracker regions, then stop allocating once the largest has been seen. The view doesn't own the
+// memory, so it's only valid until buffer is next fitted.
+cv::Mat fitBuffer(cv::Mat& buffer, cv::Size size, int type);
+
+// Heckbert's closed form homography taking the unit square's corners (0, 0), (1, 0), (1, 1), (0, 1) onto points.
+// False when the points are degenerate.
+bool unitSquareHomography(const cv::Point2f* points, cv::Matx33d& homography);
+
+// A camera's dispatch budget and work totals, shared by the dispatcher and workers without a lock. Each camera's set
+// has a cache line to itself, so workers finishing one camera's frames don't keep invalidating another camera's.
+struct alignas(64) CameraThreadset {
+    // Iterations that may be in flight at once, set by AllocationController.
+    std::atomic<int> totalThreads;
+    std::atomic<int> activeThreads;
+    std::atomic<int64_t> lastThreadActivateTime;
+
+    // Running totals of finished iterations, those that found tags, and the time workers spent on them after claiming
+    // a frame, sampled by AllocationController.
+    std::atomic<uint64_t> iterations;
+    std::atomic<uint64_t> usefulIterations;
+    std::atomic<int64_t> busyMicros;
+
+    explicit CameraThreadset(int totalThreads);
+
+    // Takes an in-flight slot if fewer than totalThreads are taken. Each admitted iteration must be released once it
+    // finishes; lowering totalThreads only stops admission until enough have been.
+    bool admit(int64_t now);
+    void release();
+    // Whether admit would fail now.
+    bool full() const;
+
+    void recordIteration(bool foundTags, int64_t busyMicros);
 };
 
 #endif //UTILS_H
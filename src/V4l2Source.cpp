@@ -0,0 +1,198 @@
+#include "V4l2Source.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <ntcore/networktables/NetworkTableInstance.h>
+
+#include "Log.h"
+
+using namespace std;
+using namespace cv;
+
+static const int requestedBuffers = 4;
+static const int readTimeoutMillis = 1000;
+
+static int xioctl(int fd, unsigned long request, void* argument) {
+    int result;
+    do {
+        result = ioctl(fd, request, argument);
+    } while (result == -1 && errno == EINTR);
+
+    return result;
+}
+
+V4l2Source::V4l2Source(const SourceConfig& config) {
+    this->fd = -1;
+    this->mjpeg = config.pixelFormat == "MJPG";
+    this->width = 0;
+    this->height = 0;
+    this->bytesPerLine = 0;
+    this->dropped.store(0);
+
+    if (!setup(config)) {
+        LOG_ERROR("Could not start V4L2 capture on %s: %s", config.path.c_str(), strerror(errno));
+    }
+}
+
+bool V4l2Source::setup(const SourceConfig& config) {
+    fd = open(config.path.c_str(), O_RDWR | O_NONBLOCK);
+    if (fd < 0) {
+        return false;
+    }
+
+    v4l2_format format = {};
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    format.fmt.pix.width = config.width;
+    format.fmt.pix.height = config.height;
+    format.fmt.pix.pixelformat = mjpeg ? V4L2_PIX_FMT_MJPEG : V4L2_PIX_FMT_YUYV;
+    format.fmt.pix.field = V4L2_FIELD_NONE;
+
+    if (xioctl(fd, VIDIOC_S_FMT, &format) < 0) {
+        return false;
+    }
+
+    if (format.fmt.pix.pixelformat != (mjpeg ? V4L2_PIX_FMT_MJPEG : V4L2_PIX_FMT_YUYV)) {
+        errno = EINVAL;
+        return false;
+    }
+
+    width = static_cast<int>(format.fmt.pix.width);
+    height = static_cast<int>(format.fmt.pix.height);
+    bytesPerLine = static_cast<int>(format.fmt.pix.bytesperline);
+
+    if (width != config.width || height != config.height) {
+        LOG_WARNING("%s runs at %dx%d instead of the configured %dx%d", config.path.c_str(), width, height,
+            config.width, config.height);
+    }
+
+    if (config.fps > 0) {
+        v4l2_streamparm streamParameters = {};
+        streamParameters.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        streamParameters.parm.capture.timeperframe.numerator = 1;
+        streamParameters.parm.capture.timeperframe.denominator = static_cast<uint32_t>(config.fps);
+
+        // Not every driver lets the rate be set; it just keeps its own.
+        xioctl(fd, VIDIOC_S_PARM, &streamParameters);
+    }
+
+    v4l2_requestbuffers request = {};
+    request.count = requestedBuffers;
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+
+    if (xioctl(fd, VIDIOC_REQBUFS, &request) < 0) {
+        return false;
+    }
+
+    for (uint32_t a = 0; a < request.count; a++) {
+        v4l2_buffer buffer = {};
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index = a;
+
+        if (xioctl(fd, VIDIOC_QUERYBUF, &buffer) < 0) {
+            return false;
+        }
+
+        void* start = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buffer.m.offset);
+        if (start == MAP_FAILED) {
+            return false;
+        }
+        buffers.push_back({start, buffer.length});
+
+        if (xioctl(fd, VIDIOC_QBUF, &buffer) < 0) {
+            return false;
+        }
+    }
+
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    return xioctl(fd, VIDIOC_STREAMON, &type) == 0;
+}
+
+V4l2Source::~V4l2Source() {
+    if (fd >= 0) {
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(fd, VIDIOC_STREAMOFF, &type);
+    }
+
+    for (const MappedBuffer& buffer : buffers) {
+        munmap(buffer.start, buffer.length);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+uint64_t V4l2Source::droppedFrames() const {
+    return dropped.load(memory_order_relaxed);
+}
+
+bool V4l2Source::read(Mat& image, int64_t& timestamp) {
+    if (fd < 0 || buffers.empty()) {
+        return false;
+    }
+
+    pollfd ready = {fd, POLLIN, 0};
+    if (poll(&ready, 1, readTimeoutMillis) <= 0) {
+        return false;
+    }
+
+    v4l2_buffer buffer = {};
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+
+    if (xioctl(fd, VIDIOC_DQBUF, &buffer) < 0) {
+        return false;
+    }
+
+    // If capture fell behind, more frames are already waiting. Hand back all but the newest rather than working
+    // through a queue of stale ones.
+    pollfd waiting = {fd, POLLIN, 0};
+    while (poll(&waiting, 1, 0) > 0) {
+        v4l2_buffer newer = {};
+        newer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        newer.memory = V4L2_MEMORY_MMAP;
+
+        if (xioctl(fd, VIDIOC_DQBUF, &newer) < 0) {
+            break;
+        }
+
+        xioctl(fd, VIDIOC_QBUF, &buffer);
+        buffer = newer;
+        dropped.fetch_add(1, memory_order_relaxed);
+    }
+
+    uint8_t* data = static_cast<uint8_t*>(buffers[buffer.index].start);
+
+    // Both paths read the driver's buffer in place and write the frame's own buffer, which is reused across frames.
+    if (mjpeg) {
+        Mat encoded(1, static_cast<int>(buffer.bytesused), CV_8UC1, data);
+        imdecode(encoded, IMREAD_GRAYSCALE, &image);
+    } else {
+        Mat yuyv(height, width, CV_8UC2, data, static_cast<size_t>(bytesPerLine));
+        cvtColor(yuyv, image, COLOR_YUV2GRAY_YUYV);
+    }
+
+    if ((buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        timestamp = clock.toNtTime(static_cast<int64_t>(buffer.timestamp.tv_sec) * 1000000 +
+            buffer.timestamp.tv_usec);
+    } else {
+        timestamp = nt::Now();
+    }
+
+    xioctl(fd, VIDIOC_QBUF, &buffer);
+
+    return !image.empty();
+}
@@ -0,0 +1,43 @@
+#ifndef V4L2SOURCE_H
+#define V4L2SOURCE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+
+#include "FrameSource.h"
+
+// Captures straight from a V4L2 device through mmap'd driver buffers and hands out 8-bit grayscale only. YUYV frames
+// are read in place and their luma deinterleaved into the frame in one pass; MJPEG frames are decoded from the
+// driver buffer directly to grayscale, skipping chroma entirely. Replaces VideoCapture's decode to BGR plus its copy
+// into the caller's Mat.
+class V4l2Source : public FrameSource {
+    public:
+        explicit V4l2Source(const SourceConfig& config);
+        ~V4l2Source() override;
+
+        bool read(cv::Mat& image, int64_t& timestamp) override;
+        uint64_t droppedFrames() const override;
+    private:
+        struct MappedBuffer {
+            void* start;
+            size_t length;
+        };
+
+        int fd;
+        bool mjpeg;
+        int width;
+        int height;
+        int bytesPerLine;
+        std::atomic<uint64_t> dropped;
+
+        std::vector<MappedBuffer> buffers;
+        CaptureClock clock;
+
+        bool setup(const SourceConfig& config);
+};
+
+#endif //V4L2SOURCE_H